@@ -0,0 +1,174 @@
+/*
+ * The file list and worker threads shared by the batch modes of mf2t
+ * and t2mf and by mfcheck; see batch.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#if _POSIX_C_SOURCE >= 2
+#include <pthread.h>
+#include <dirent.h>
+#endif
+#include <sys/stat.h>
+
+#include "batch.h"
+
+static char **Files;
+static int NFiles;
+static int NextFile;		/* next file for a worker to take */
+#if _POSIX_C_SOURCE >= 2
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+addfile(const char *name) {
+    char **more, *copy;
+
+    if ((copy = strdup(name)) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    if ((NFiles & (NFiles - 1)) == 0) {
+        more = realloc(Files, (NFiles ? 2*NFiles : 1) * sizeof(*more));
+        if (more == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        Files = more;
+    }
+    Files[NFiles++] = copy;
+}
+
+/* 1 if name ends in ext, in either case */
+static int
+hasext(const char *name, const char *ext) {
+    const char *dot = strrchr(name, '.');
+
+    if (dot == NULL || strlen(dot) != strlen(ext))
+        return(0);
+    while (*dot && tolower((unsigned char)*dot) == *ext)
+        dot++, ext++;
+    return(*dot == '\0');
+}
+
+int
+batch_ismidi(const char *name) {
+    return(hasext(name, ".mid") || hasext(name, ".midi"));
+}
+
+int
+batch_istext(const char *name) {
+    return(hasext(name, ".txt"));
+}
+
+void
+batch_addarg(const char *name, int (*wanted)(const char *)) {
+#if _POSIX_C_SOURCE >= 2
+    struct stat st;
+    struct dirent *d;
+    DIR *dir;
+    char *path;
+    size_t n;
+
+    if (stat(name, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if ((dir = opendir(name)) == NULL) {
+            perror(name);
+            exit(1);
+        }
+        while ((d = readdir(dir)) != NULL) {
+            if (!wanted(d->d_name))
+                continue;
+            n = strlen(name) + strlen(d->d_name) + 2;
+            if ((path = malloc(n)) == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+            sprintf(path, "%s/%s", name, d->d_name);
+            addfile(path);
+            free(path);
+        }
+        closedir(dir);
+        return;
+    }
+#else
+    (void) wanted;
+#endif
+    addfile(name);
+}
+
+void
+batch_addlist(const char *list, int (*wanted)(const char *)) {
+    FILE *fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    char line[4096];
+    size_t n;
+
+    if (fp == NULL) {
+        perror(list);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        n = strcspn(line, "\r\n");
+        line[n] = '\0';
+        if (n > 0)
+            batch_addarg(line, wanted);
+    }
+    if (fp != stdin)
+        fclose(fp);
+}
+
+int
+batch_nfiles(void) {
+    return(NFiles);
+}
+
+/* the next file for a worker, or NULL */
+const char *
+batch_next(void) {
+    const char *name;
+
+#if _POSIX_C_SOURCE >= 2
+    pthread_mutex_lock(&Lock);
+#endif
+    name = NextFile < NFiles ? Files[NextFile++] : NULL;
+#if _POSIX_C_SOURCE >= 2
+    pthread_mutex_unlock(&Lock);
+#endif
+    return(name);
+}
+
+int
+batch_run(int jobs, void *(*worker)(void *)) {
+    int failures = 0, i, nthreads = 0;
+#if _POSIX_C_SOURCE >= 2
+    pthread_t *threads = NULL;
+    int *counts = NULL;
+
+    if (jobs > NFiles)
+        jobs = NFiles;
+    if (jobs > 1 && (threads = malloc(jobs * sizeof(*threads))) != NULL &&
+            (counts = calloc(jobs, sizeof(*counts))) != NULL)
+        for (; nthreads < jobs - 1; nthreads++)
+            if (pthread_create(&threads[nthreads], NULL, worker,
+                    &counts[nthreads]) != 0)
+                break;
+#else
+    (void) jobs;
+#endif
+    worker(&failures);		/* the main thread helps too */
+#if _POSIX_C_SOURCE >= 2
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        failures += counts[i];
+    }
+    free(threads);
+    free(counts);
+#endif
+    for (i = 0; i < NFiles; i++)
+        free(Files[i]);
+    free(Files);
+    Files = NULL;
+    NFiles = NextFile = 0;
+    return(failures);
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+ * The list of files for mf2t -B, t2mf -B and mfcheck, and the threads
+ * that work through it.  Names are added first, from the main thread;
+ * then batch_run() starts jobs - 1 threads running worker, and runs it
+ * in the main thread too.  Each takes names with batch_next() until it
+ * gets NULL, counting the files that failed in the int its argument
+ * points at.
+ */
+
+/* for wanted below: 1 if name ends in .mid or .midi (.txt), in any case */
+extern int batch_ismidi(const char *name);
+extern int batch_istext(const char *name);
+
+/* a file, or the files in a directory that wanted says 1 to */
+extern void batch_addarg(const char *name, int (*wanted)(const char *));
+
+/* the names in a list file (- for stdin), one to a line */
+extern void batch_addlist(const char *list, int (*wanted)(const char *));
+
+extern int batch_nfiles(void);
+extern const char *batch_next(void);
+
+/* run worker over all the files and free them; the number that failed */
+extern int batch_run(int jobs, void *(*worker)(void *));
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * bufbench
+ *
+ * Compare decoding a MIDI file a byte at a time through getchar,
+ * mfread(), with decoding it from memory, mfread_buf(), as mf2t does
+ * for a pipe and for a regular file.  The file is scaled up first: the
+ * events of each track (less its End of Track) are repeated until it
+ * is about MB megabytes, so the time is that of the reader rather than
+ * of starting it.  The handlers count the note ons and sum their
+ * pitches, as in readbench, and the two counts must agree.
+ *
+ * Usage: bufbench [-n MB] midifile
+ *
+ * Each reader is run three times and the best is reported in MB/s,
+ * with the speed of mfread_buf() over that of mfread().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "midifile.h"
+
+static long Notes, Sum;
+
+static void
+on(int chan, int pitch, int vol) {
+    (void) chan;
+    if (vol > 0) {
+	Notes++;
+	Sum += pitch;
+    }
+}
+
+static void
+fail(char *s) {
+    fprintf(stderr, "bufbench: %s\n", s);
+    exit(1);
+}
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long
+get32(const mf_data_t *p) {
+    return ((unsigned long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void
+put32(mf_data_t *p, unsigned long v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+ * The len bytes of the file at in, with each track’s events repeated
+ * times times, in a buffer of its own; its length is put in *lenp.
+ */
+static mf_data_t *
+scale(const mf_data_t *in, size_t len, long times, size_t *lenp) {
+    const mf_data_t *p = in, *end = in + len;
+    mf_data_t *out, *q;
+    unsigned long leng, body;
+    long i;
+
+    if (len < 14 || memcmp(in, "MThd", 4) != 0)
+	fail("not a MIDI file");
+    if ((out = malloc(len * times)) == NULL)
+	fail("out of memory");
+    leng = 8 + get32(in + 4);
+    memcpy(out, in, leng);
+    p += leng;
+    q = out + leng;
+    while (end - p >= 8 && memcmp(p, "MTrk", 4) == 0) {
+	leng = get32(p + 4);
+	p += 8;
+	if (leng > (unsigned long)(end - p))
+	    fail("track runs past the end of the file");
+	/* the End of Track and its delta time go on the last copy only */
+	body = leng;
+	if (leng >= 4 && memcmp(p + leng - 3, "\377\057\000", 3) == 0) {
+	    body = leng - 4;
+	    while (body > 0 && (p[body - 1] & 0x80))
+		body--;
+	}
+	memcpy(q, "MTrk", 4);
+	put32(q + 4, body * times + leng - body);
+	q += 8;
+	for (i = 0; i < times; i++, q += body)
+	    memcpy(q, p, body);
+	memcpy(q, p + body, leng - body);
+	q += leng - body;
+	p += leng;
+    }
+    *lenp = q - out;
+    return(out);
+}
+
+int
+main(int argc, char **argv) {
+    double mb = 20, t, best, getct = 0, buft = 0;
+    mf_data_t *buf, *big;
+    size_t len, n, size;
+    long getcnotes = 0;
+    FILE *fp;
+    int i, k;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+	mb = atof(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc != 2) {
+	fprintf(stderr, "Usage: bufbench [-n MB] midifile\n");
+	return 1;
+    }
+    if ((fp = fopen(argv[1], "rb")) == NULL) {
+	perror(argv[1]);
+	return 1;
+    }
+    for (len = 0, size = 4096, buf = NULL; ; len += n, size *= 2) {
+	if ((buf = realloc(buf, size)) == NULL)
+	    fail("out of memory");
+	if ((n = fread(buf + len, 1, size - len, fp)) < size - len) {
+	    len += n;
+	    break;
+	}
+    }
+    fclose(fp);
+    big = scale(buf, len, (long)(mb * 1e6 / len) + 1, &size);
+
+    /* mfread() reads stdin, so put the scaled file there */
+    if ((fp = tmpfile()) == NULL || fwrite(big, 1, size, fp) != size ||
+	    fflush(fp) != 0 || dup2(fileno(fp), 0) < 0)
+	fail("can’t write a temporary file");
+    fclose(fp);
+
+    Mf_on = on;
+    Mf_rerror = fail;
+    for (k = 0; k < 2; k++) {
+	best = 0;
+	for (i = 0; i < 3; i++) {
+	    Notes = Sum = 0;
+	    t = now();
+	    if (k == 0) {
+		Mf_getc = getchar;
+		rewind(stdin);
+		mfread();
+	    } else {
+		Mf_getc = NULL;
+		mfread_buf(big, size);
+	    }
+	    t = now() - t;
+	    if (i == 0 || t < best)
+		best = t;
+	}
+	if (k == 0) {
+	    getct = best;
+	    getcnotes = Notes;
+	} else
+	    buft = best;
+    }
+    if (Notes != getcnotes)
+	fail("note counts differ");
+
+    printf("%-24s %8s %12s %14s %8s\n", "file", "MB", "mfread MB/s",
+	    "mfread_buf MB/s", "ratio");
+    printf("%-24s %8.1f %12.1f %14.1f %8.2f\n", argv[1], size / 1e6,
+	    size / getct / 1e6, size / buft / 1e6, getct / buft);
+    free(big);
+    free(buf);
+    return 0;
+}
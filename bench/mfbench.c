@@ -0,0 +1,680 @@
+/*
+ * mfbench
+ *
+ * Time each stage of the conversions on generated MIDI files: decoding
+ * with mfread_buf_r(), encoding with the mf_w_*_r() functions, mf2t
+ * turning a file into text, and the t2mf scanner reading that text.
+ * The files are made up here, the same each time, in these mixes:
+ *
+ *	notes	dense notes, written with running status
+ *	ctrl	controller and pitch bend streams
+ *	tracks	many short tracks
+ *	sysex	large sysex messages
+ *	text	many text meta events between the notes
+ *	mixed	some of everything
+ *
+ * Usage: mfbench [-s MB] [-t tracks] [-k mix] [-p mf2t] [-g midifile]
+ *
+ * Each mix (or only the one given with -k) is made about MB megabytes
+ * (default 8) long, in the given number of tracks (default 16; the
+ * tracks mix has 64 times as many).  Each stage is run at least three
+ * times and for a quarter of a second, and the best time is reported
+ * as MB/s of its input and events/s.  mf2t (default ./mf2t) is run as
+ * a program, on a temporary file, so its time includes starting up and
+ * decoding; the others run in here.  The encoded file must come out
+ * just as it was generated.  With -g the file for the mix is written
+ * to midifile instead, and mf2t can turn it into text.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "midifile.h"
+#include "t2mf.h"
+
+enum { NOTES, CTRL, TRACKS, SYSEX_MIX, TEXT_MIX, MIXED, NMIXES };
+
+static const char *Mixes[] = {
+    "notes", "ctrl", "tracks", "sysex", "text", "mixed"
+};
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a growing buffer for the writer’s output */
+struct sink {
+    mf_data_t *buf;
+    mf_size_t leng, size;
+};
+
+static int
+sinkput(struct sink *s, const mf_data_t *buf, mf_size_t size) {
+    mf_data_t *more;
+
+    if (s->leng + size > s->size) {
+        do
+            s->size = s->size ? 2 * s->size : 65536;
+        while (s->leng + size > s->size);
+        if ((more = realloc(s->buf, s->size)) == NULL)
+            return(-1);
+        s->buf = more;
+    }
+    memcpy(s->buf + s->leng, buf, size);
+    s->leng += size;
+    return(size);
+}
+
+/*
+ * The generator.  Each track is filled with the mix until about its
+ * share of the bytes has been written; the writer adds the end of
+ * track.
+ */
+
+struct gen {
+    struct sink out;		/* first, for genputbuf() */
+    int mix;
+    long bytes;			/* to write in each track */
+    long left;			/* of them still to write in this one */
+    int chan;
+    unsigned long seed;
+    long events;		/* written in all */
+    mf_data_t data[65536 + 2];	/* sysex or text */
+};
+
+static unsigned
+rnd(struct gen *g, unsigned n) {
+    g->seed = g->seed * 1103515245 + 12345;
+    return (g->seed >> 16) % n;
+}
+
+static void
+midi(struct mf_writer *w, mf_deltat_t delta, int type, int d1, int d2) {
+    struct gen *g = w->data;
+    mf_data_t data[2];
+    int n = (type == program_chng || type == channel_aftertouch) ? 1 : 2;
+
+    data[0] = d1;
+    data[1] = d2;
+    mf_w_midi_event_r(w, delta, type, g->chan, data, n);
+    g->left -= n + 2;
+    g->events++;
+}
+
+static void
+meta(struct mf_writer *w, mf_deltat_t delta, int type, mf_size_t size) {
+    struct gen *g = w->data;
+
+    mf_w_meta_event_r(w, delta, type, g->data, size);
+    g->left -= size + 4;
+    g->events++;
+}
+
+static void
+sysex(struct mf_writer *w, mf_deltat_t delta, mf_size_t size) {
+    struct gen *g = w->data;
+    mf_size_t i;
+
+    g->data[0] = 0xf0;
+    for (i = 1; i < size - 1; i++)
+        g->data[i] = rnd(g, 128);
+    g->data[size - 1] = 0xf7;
+    mf_w_sysex_event_r(w, delta, g->data, size);
+    g->left -= size + 4;
+    g->events++;
+}
+
+/* a text meta event of words */
+static void
+text(struct mf_writer *w, mf_deltat_t delta, int type, mf_size_t size) {
+    static const char words[] = "la la sing of the night the day is done ";
+    struct gen *g = w->data;
+    mf_size_t i;
+
+    for (i = 0; i < size; i++)
+        g->data[i] = words[(i + rnd(g, 4)) % (sizeof(words) - 1)];
+    meta(w, delta, type, size);
+}
+
+static void
+notepair(struct mf_writer *w, mf_deltat_t delta, int length) {
+    struct gen *g = w->data;
+    int note = 36 + rnd(g, 48);
+
+    midi(w, delta, note_on, note, 1 + rnd(g, 127));
+    midi(w, length, note_on, note, 0);
+}
+
+static void
+genwtrack(struct mf_writer *w) {
+    struct gen *g = w->data;
+    int i, v, cc;
+    mf_size_t n;
+
+    g->left = g->bytes;
+    g->chan = (w->track - 1) % 16;
+    n = sprintf((char *)g->data, "Track %d", w->track);
+    meta(w, 0, sequence_name, n);
+    midi(w, 0, program_chng, rnd(g, 128), 0);
+    while (g->left > 0) {
+        switch (g->mix) {
+        case NOTES:
+        case TRACKS:
+            for (i = rnd(g, 4); i > 0; i--)	/* a chord */
+                midi(w, 0, note_on, 36 + rnd(g, 48), 1 + rnd(g, 127));
+            notepair(w, rnd(g, 4) ? 24 : 0, 24);
+            break;
+
+        case CTRL:
+            if (rnd(g, 4) == 0) {
+                v = rnd(g, 16384);
+                for (i = 0; i < 32; i++, v = (v + 97) % 16384)
+                    midi(w, 2, pitch_wheel, v & 0x7f, v >> 7);
+            } else {
+                cc = "\001\007\012\013\112"[rnd(g, 5)];
+                for (i = 0, v = rnd(g, 128); i < 32; i++, v = (v + 3) % 128)
+                    midi(w, 2, control_change, cc, v);
+            }
+            notepair(w, 0, 48);
+            break;
+
+        case SYSEX_MIX:
+            sysex(w, 96, 1024 + rnd(g, 65536 - 1024));
+            notepair(w, 0, 96);
+            break;
+
+        case TEXT_MIX:
+            text(w, 48, rnd(g, 2) ? lyric : marker, 8 + rnd(g, 56));
+            notepair(w, 0, 48);
+            break;
+
+        case MIXED:
+            switch (rnd(g, 64)) {
+            case 0:
+                sysex(w, 0, 16 + rnd(g, 240));
+                break;
+            case 1:
+                text(w, 0, text_event, 8 + rnd(g, 56));
+                break;
+            case 2:
+                if (g->chan == 0) {
+                    mf_w_tempo_r(w, 0, 400000 + rnd(g, 200000));
+                    g->left -= 7;
+                    g->events++;
+                }
+                break;
+            case 3:
+            case 4:
+                midi(w, 0, pitch_wheel, rnd(g, 128), rnd(g, 128));
+                break;
+            case 5:
+            case 6:
+            case 7:
+                midi(w, 0, control_change, 7, rnd(g, 128));
+                break;
+            }
+            notepair(w, 96, 96);
+            break;
+        }
+    }
+    g->events++;			/* the end of track */
+}
+
+static int
+genputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    return sinkput(w->data, buf, size);
+}
+
+/* make about mb megabytes of the mix in ntracks tracks in g->out */
+static void
+generate(struct gen *g, int mix, double mb, int ntracks) {
+    struct mf_writer w;
+
+    if (mix == TRACKS)
+        ntracks *= 64;
+    memset(g, 0, offsetof(struct gen, data));
+    g->mix = mix;
+    g->bytes = mb * 1e6 / ntracks;
+    g->seed = mix + 1;
+    mf_writer_init(&w);
+    w.Mf_putbuf = genputbuf;
+    w.Mf_wtrack = genwtrack;
+    w.runstat = 1;
+    w.data = g;
+    mf_w_header_r(&w, 1, ntracks, 96);
+    while (w.track < ntracks)
+        mf_w_track_r(&w);
+    mf_writer_free(&w);
+}
+
+/* decoding: count what the handlers are given */
+
+static long Count;
+
+static void
+c3(struct mf_reader *r, int a, int b, int c) {
+    (void) r; (void) a; (void) b; (void) c;
+    Count++;
+}
+
+static void
+c2(struct mf_reader *r, int a, int b) {
+    (void) r; (void) a; (void) b;
+    Count++;
+}
+
+static void
+cmess(struct mf_reader *r, int leng, char *mess) {
+    (void) r; (void) leng; (void) mess;
+    Count++;
+}
+
+static void
+ctmess(struct mf_reader *r, int type, int leng, char *mess) {
+    (void) r; (void) type; (void) leng; (void) mess;
+    Count++;
+}
+
+static void
+c0(struct mf_reader *r) {
+    (void) r;
+    Count++;
+}
+
+static void
+ctempo(struct mf_reader *r, mf_tempo_t tempo) {
+    (void) r; (void) tempo;
+    Count++;
+}
+
+static void
+ctimesig(struct mf_reader *r, int nn, int dd, int cc, int bb) {
+    (void) r; (void) nn; (void) dd; (void) cc; (void) bb;
+    Count++;
+}
+
+static void
+csmpte(struct mf_reader *r, int hr, int mn, int se, int fr, int ff) {
+    (void) r; (void) hr; (void) mn; (void) se; (void) fr; (void) ff;
+    Count++;
+}
+
+static void
+cseqnum(struct mf_reader *r, int num) {
+    (void) r; (void) num;
+    Count++;
+}
+
+static void
+countfuncs(struct mf_reader *r) {
+    mf_reader_init(r);
+    r->Mf_on = r->Mf_off = r->Mf_pressure = c3;
+    r->Mf_parameter = r->Mf_pitchbend = c3;
+    r->Mf_program = r->Mf_chanpressure = r->Mf_keysig = c2;
+    r->Mf_sysex = r->Mf_sqspecific = r->Mf_arbitrary = cmess;
+    r->Mf_text = r->Mf_metamisc = ctmess;
+    r->Mf_eot = c0;
+    r->Mf_tempo = ctempo;
+    r->Mf_timesig = ctimesig;
+    r->Mf_smpte = csmpte;
+    r->Mf_seqnum = cseqnum;
+}
+
+/*
+ * Encoding: the file is first decoded into an array of events, with
+ * their payloads copied out, which the writer then puts back together.
+ */
+
+struct song {
+    struct sink out;		/* first, for songputbuf() */
+    int format, ntracks, division;
+    struct mf_event *ev;
+    long nev, evsize;
+    long *start;		/* each track’s first event, and nev */
+    int track;			/* being written */
+    char *payload;
+    mf_size_t pleng, psize;
+    mf_data_t arb[65536 + 1];	/* an arbitrary event, with its 0xf7 */
+};
+
+static void
+songheader(struct mf_reader *r, int format, int ntrks, int division) {
+    struct song *s = r->data;
+
+    s->format = format;
+    s->ntracks = ntrks;
+    s->division = division;
+    s->start = calloc(ntrks + 1, sizeof(*s->start));
+}
+
+static void
+songtrack(struct mf_reader *r) {
+    struct song *s = r->data;
+
+    if (s->track < s->ntracks)
+        s->start[s->track++] = s->nev;
+}
+
+static void
+songevents(struct mf_reader *r, const struct mf_event *ev, int n,
+        const char *payload) {
+    struct song *s = r->data;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (s->nev == s->evsize) {
+            s->evsize = s->evsize ? 2 * s->evsize : 4096;
+            s->ev = realloc(s->ev, s->evsize * sizeof(*s->ev));
+        }
+        while (s->pleng + ev[i].leng > s->psize) {
+            s->psize = s->psize ? 2 * s->psize : 65536;
+            s->payload = realloc(s->payload, s->psize);
+        }
+        if (s->ev == NULL || s->payload == NULL) {
+            fprintf(stderr, "mfbench: out of memory\n");
+            exit(1);
+        }
+        s->ev[s->nev] = ev[i];
+        s->ev[s->nev].offset = s->pleng;
+        memcpy(s->payload + s->pleng, payload + ev[i].offset, ev[i].leng);
+        s->pleng += ev[i].leng;
+        s->nev++;
+    }
+}
+
+static void
+songwtrack(struct mf_writer *w) {
+    struct song *s = w->data;
+    struct mf_event *e = s->ev + s->start[s->track];
+    struct mf_event *end = s->ev + s->start[s->track + 1];
+    mf_data_t *p, data[2];
+    mf_deltat_t last = 0;
+
+    for (; e < end; e++) {
+        p = (mf_data_t *)s->payload + e->offset;
+        switch (e->status) {
+        case 0xff:
+            mf_w_meta_event_r(w, e->time - last, e->data1, p, e->leng);
+            break;
+        case 0xf0:
+            mf_w_sysex_event_r(w, e->time - last, p, e->leng);
+            break;
+        case 0xf7:
+            s->arb[0] = 0xf7;
+            memcpy(s->arb + 1, p, e->leng);
+            mf_w_sysex_event_r(w, e->time - last, s->arb, e->leng + 1);
+            break;
+        default:
+            data[0] = e->data1;
+            data[1] = e->data2;
+            mf_w_midi_event_r(w, e->time - last, e->status & 0xf0,
+                    e->status & 0xf, data, (e->status & 0xe0) == 0xc0 ? 1 : 2);
+        }
+        last = e->time;
+    }
+    s->track++;
+}
+
+static int
+songputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    return sinkput(w->data, buf, size);
+}
+
+static void
+decode(struct song *s, const mf_data_t *buf, mf_size_t len) {
+    static struct mf_event events[1024];
+    struct mf_reader r;
+
+    memset(s, 0, offsetof(struct song, arb));
+    mf_reader_init(&r);
+    r.Mf_header = songheader;
+    r.Mf_starttrack = songtrack;
+    r.Mf_events = songevents;
+    r.events = events;
+    r.maxevents = sizeof(events) / sizeof(events[0]);
+    r.data = s;
+    mfread_buf_r(&r, buf, len);
+    mf_reader_free(&r);
+    s->start[s->ntracks] = s->nev;
+}
+
+static void
+encode(struct song *s) {
+    struct mf_writer w;
+
+    s->out.leng = 0;
+    s->track = 0;
+    mf_writer_init(&w);
+    w.Mf_putbuf = songputbuf;
+    w.Mf_wtrack = songwtrack;
+    w.runstat = 1;
+    w.data = s;
+    mfwrite_r(&w, s->format, s->ntracks, s->division, NULL);
+    mf_writer_free(&w);
+}
+
+/* the t2mf scanner needs these from t2mf.c */
+
+void
+error(struct t2mf *t, const char *s) {
+    (void) s;
+    t->errors++;
+}
+
+bankno_t
+bankno(char *s, int n) {
+    (void) s; (void) n;
+    return 0;			/* mf2t doesn’t write $ banks */
+}
+
+/*
+ * Timing.  Each stage is a function run on the mix until it has had
+ * at least three goes and a quarter of a second; the best go counts.
+ */
+
+struct stage {
+    const char *name;
+    double best;		/* seconds */
+    double mb;			/* of input */
+};
+
+static struct gen Gen;
+static struct song Song;
+static struct t2mf Scan;
+static unsigned char *ScanStart;
+static const char *Mf2t = "./mf2t";
+static char Midname[] = "/tmp/mfbenchXXXXXX";
+static char Txtname[sizeof(Midname) + 4];
+
+static int
+runread(void) {
+    struct mf_reader r;
+
+    countfuncs(&r);
+    Count = 0;
+    mfread_buf_r(&r, Gen.out.buf, Gen.out.leng);
+    mf_reader_free(&r);
+    return(0);
+}
+
+static int
+runwrite(void) {
+    encode(&Song);
+    return(0);
+}
+
+static int
+runmf2t(void) {
+    char cmd[1024];
+
+    snprintf(cmd, sizeof(cmd), "%s -j 1 %s %s", Mf2t, Midname, Txtname);
+    return(system(cmd));
+}
+
+static int
+runscan(void) {
+    Scan.cur = ScanStart;
+    Scan.state = 0;
+    Scan.do_hex = 0;
+    Scan.lineno = 1;
+    while (yylex(&Scan) != EOF)
+        ;
+    return(0);
+}
+
+static int
+timeit(struct stage *st, int (*run)(void)) {
+    double t, start = now();
+    int n;
+
+    st->best = 0;
+    for (n = 0; n < 3 || now() - start < 0.25; n++) {
+        t = now();
+        if (run() != 0)
+            return(-1);
+        t = now() - t;
+        if (st->best == 0 || t < st->best)
+            st->best = t;
+    }
+    return(0);
+}
+
+static void
+usage(void) {
+    fprintf(stderr, "Usage: mfbench [-s MB] [-t tracks] [-k mix] [-p mf2t] "
+            "[-g midifile]\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv) {
+    struct stage st[4];
+    const char *genfile = NULL;
+    double mb = 8;
+    int ntracks = 16, only = -1;
+    int c, fd, i, mix, status = 0;
+    long events;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "s:t:k:p:g:")) != -1) {
+        switch (c) {
+        case 's':
+            mb = atof(optarg);
+            break;
+        case 't':
+            ntracks = atoi(optarg);
+            break;
+        case 'k':
+            for (only = 0; only < NMIXES; only++)
+                if (strcmp(optarg, Mixes[only]) == 0)
+                    break;
+            if (only == NMIXES)
+                usage();
+            break;
+        case 'p':
+            Mf2t = optarg;
+            break;
+        case 'g':
+            genfile = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (ntracks < 1)
+        ntracks = 1;
+    if (mb <= 0)
+        mb = 1;
+
+    if (genfile) {
+        generate(&Gen, only < 0 ? MIXED : only, mb, ntracks);
+        if ((fp = fopen(genfile, "wb")) == NULL ||
+                fwrite(Gen.out.buf, 1, Gen.out.leng, fp) != Gen.out.leng ||
+                fclose(fp) != 0) {
+            perror(genfile);
+            return 1;
+        }
+        return 0;
+    }
+
+    if ((fd = mkstemp(Midname)) < 0) {
+        perror(Midname);
+        return 1;
+    }
+    close(fd);
+    sprintf(Txtname, "%s.txt", Midname);
+
+    printf("%-7s %6s %9s  %-16s %-16s %-16s %-16s\n", "", "", "",
+            "mfread", "mfwrite", "mf2t", "t2mf scanner");
+    printf("%-7s %6s %9s ", "mix", "MB", "events");
+    for (i = 0; i < 4; i++)
+        printf(" %7s %8s", "MB/s", "Mev/s");
+    printf("\n");
+
+    for (mix = 0; mix < NMIXES; mix++) {
+        if (only >= 0 && mix != only)
+            continue;
+        generate(&Gen, mix, mb, ntracks);
+        decode(&Song, Gen.out.buf, Gen.out.leng);
+        if ((fp = fopen(Midname, "wb")) == NULL ||
+                fwrite(Gen.out.buf, 1, Gen.out.leng, fp) != Gen.out.leng ||
+                fclose(fp) != 0) {
+            perror(Midname);
+            status = 1;
+            break;
+        }
+
+        st[0].mb = st[1].mb = st[2].mb = Gen.out.leng / 1e6;
+        if (timeit(&st[0], runread) < 0 || timeit(&st[1], runwrite) < 0)
+            break;
+        events = Count;
+        if (Song.out.leng != Gen.out.leng ||
+                memcmp(Song.out.buf, Gen.out.buf, Gen.out.leng) != 0) {
+            fprintf(stderr, "mfbench: %s: encoded file differs\n",
+                    Mixes[mix]);
+            status = 1;
+        }
+        if (timeit(&st[2], runmf2t) < 0) {
+            fprintf(stderr, "mfbench: %s failed\n", Mf2t);
+            status = 1;
+            break;
+        }
+
+        memset(&Scan, 0, sizeof(Scan));
+        if ((fp = fopen(Txtname, "r")) == NULL || yyload(&Scan, fp) < 0) {
+            perror(Txtname);
+            status = 1;
+            break;
+        }
+        fclose(fp);
+        ScanStart = Scan.cur;
+        st[3].mb = (Scan.end - Scan.cur) / 1e6;
+        timeit(&st[3], runscan);
+        yyunload(&Scan);
+        free(Scan.inbuf);
+
+        printf("%-7s %6.1f %9ld ", Mixes[mix], Gen.out.leng / 1e6, events);
+        for (i = 0; i < 4; i++)
+            printf(" %7.1f %8.2f", st[i].mb / st[i].best,
+                    events / st[i].best / 1e6);
+        printf("\n");
+        fflush(stdout);
+
+        free(Song.ev);
+        free(Song.payload);
+        free(Song.start);
+        free(Song.out.buf);
+        free(Gen.out.buf);
+    }
+    unlink(Midname);
+    unlink(Txtname);
+    return status;
+}
@@ -0,0 +1,636 @@
+/*
+ * origbench
+ *
+ * Compare the library with the 1991 midifile.c in orig/, which it
+ * grew out of, on the same MIDI files: the speed of each at decoding a
+ * file and at encoding its events again, and that they give the same
+ * results.  Decoding goes through the handlers of each, which fold
+ * each event they are given (its time, what it is, and its data) into
+ * a hash; the hashes must match.  For encoding, the file’s events are
+ * first decoded into an array, and each writer puts them back together
+ * with running status; the files written must be the same byte for
+ * byte.  The old writer needs to seek on its output, so it writes to a
+ * stdio memory stream, a byte at a time through Mf_putc, as mf2t and
+ * t2mf once did.
+ *
+ * Usage: origbench midifile...
+ *
+ * Each is run at least three times and for a quarter of a second, and
+ * the best time is reported as MB/s of the file, with the new speed
+ * over the old.  The exit status is 1 if any results differ, so it can
+ * stand as a check on changes to the library.  mfbench -g makes files
+ * to try.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "midifile.h"
+
+/* the old library, as renamed by origmidifile.c */
+
+extern int (*orig_Mf_getc)(void);
+extern int (*orig_Mf_error)(char *s);
+extern int (*orig_Mf_header)(int format, int ntrks, int division);
+extern int (*orig_Mf_starttrack)(void);
+extern int (*orig_Mf_endtrack)(void);
+extern int (*orig_Mf_on)(int chan, int pitch, int vol);
+extern int (*orig_Mf_off)(int chan, int pitch, int vol);
+extern int (*orig_Mf_pressure)(int chan, int pitch, int press);
+extern int (*orig_Mf_parameter)(int chan, int control, int value);
+extern int (*orig_Mf_pitchbend)(int chan, int lsb, int msb);
+extern int (*orig_Mf_program)(int chan, int program);
+extern int (*orig_Mf_chanpressure)(int chan, int press);
+extern int (*orig_Mf_sysex)(int leng, char *mess);
+extern int (*orig_Mf_metamisc)(int type, int leng, char *mess);
+extern int (*orig_Mf_sqspecific)(int leng, char *mess);
+extern int (*orig_Mf_seqnum)(int num);
+extern int (*orig_Mf_text)(int type, int leng, char *mess);
+extern int (*orig_Mf_eot)(void);
+extern int (*orig_Mf_timesig)(int nn, int dd, int cc, int bb);
+extern int (*orig_Mf_smpte)(int hr, int mn, int se, int fr, int ff);
+extern int (*orig_Mf_tempo)(long tempo);
+extern int (*orig_Mf_keysig)(int sf, int mi);
+extern int (*orig_Mf_arbitrary)(int leng, char *mess);
+extern long orig_Mf_currtime;
+extern int (*orig_Mf_putc)(int c);
+extern int (*orig_Mf_wtrack)(int track);
+extern int orig_Mf_RunStat;
+
+int orig_mfread(void);
+void orig_mfwrite(int format, int ntracks, int division, FILE *fp);
+int orig_mf_w_midi_event(unsigned long delta_time, unsigned int type,
+        unsigned int chan, unsigned char *data, unsigned long size);
+int orig_mf_w_meta_event(unsigned long delta_time, int type,
+        unsigned char *data, unsigned long size);
+int orig_mf_w_sysex_event(unsigned long delta_time, unsigned char *data,
+        unsigned long size);
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Decoding.  Both readers’ handlers come here; the payloads are only
+ * hashed when checking, so that the timing is of the readers.
+ */
+
+static unsigned long Hash;
+static long Events;
+static int Check;
+
+static void
+mix(long v) {
+    Hash = (Hash ^ (unsigned long)v) * 0x100000001b3UL;
+}
+
+static int
+event(int kind, long time, int n, int a, int b, int c) {
+    Events++;
+    mix(kind);
+    mix(time);
+    if (n > 0)
+        mix(a);
+    if (n > 1)
+        mix(b);
+    if (n > 2)
+        mix(c);
+    return(0);
+}
+
+static int
+message(int kind, long time, int type, int leng, const char *mess) {
+    int i;
+
+    event(kind, time, 2, type, leng, 0);
+    if (Check)
+        for (i = 0; i < leng; i++)
+            mix(mess[i]);
+    return(0);
+}
+
+/*
+ * Each handler comes in two: o_on() for the old reader and n_on() for
+ * the library’s, alike but for how they are called and find the time.
+ */
+
+#define HANDLERS(NAME, ARGS, RARGS, CALL) \
+    static int \
+    o_##NAME ARGS { \
+        long time = orig_Mf_currtime; \
+        return CALL; \
+    } \
+    static void \
+    n_##NAME RARGS { \
+        long time = r->currtime; \
+        (void) CALL; \
+    }
+
+HANDLERS(endtrack, (void), (struct mf_reader *r),
+	event(2, time, 0, 0, 0, 0))
+HANDLERS(on, (int c, int p, int v),
+	(struct mf_reader *r, int c, int p, int v),
+	event(0x90, time, 3, c, p, v))
+HANDLERS(off, (int c, int p, int v),
+	(struct mf_reader *r, int c, int p, int v),
+	event(0x80, time, 3, c, p, v))
+HANDLERS(pressure, (int c, int p, int v),
+	(struct mf_reader *r, int c, int p, int v),
+	event(0xa0, time, 3, c, p, v))
+HANDLERS(parameter, (int c, int n, int v),
+	(struct mf_reader *r, int c, int n, int v),
+	event(0xb0, time, 3, c, n, v))
+HANDLERS(pitchbend, (int c, int l, int m),
+	(struct mf_reader *r, int c, int l, int m),
+	event(0xe0, time, 3, c, l, m))
+HANDLERS(program, (int c, int p), (struct mf_reader *r, int c, int p),
+	event(0xc0, time, 2, c, p, 0))
+HANDLERS(chanpressure, (int c, int p), (struct mf_reader *r, int c, int p),
+	event(0xd0, time, 2, c, p, 0))
+HANDLERS(sysex, (int l, char *m), (struct mf_reader *r, int l, char *m),
+	message(0xf0, time, 0, l, m))
+HANDLERS(arbitrary, (int l, char *m), (struct mf_reader *r, int l, char *m),
+	message(0xf7, time, 0, l, m))
+HANDLERS(sqspecific, (int l, char *m), (struct mf_reader *r, int l, char *m),
+	message(0x7f, time, 0, l, m))
+HANDLERS(metamisc, (int t, int l, char *m),
+	(struct mf_reader *r, int t, int l, char *m),
+	message(0xff, time, t, l, m))
+HANDLERS(text, (int t, int l, char *m),
+	(struct mf_reader *r, int t, int l, char *m),
+	message(0x01, time, t, l, m))
+HANDLERS(seqnum, (int n), (struct mf_reader *r, int n),
+	event(0x00, time, 1, n, 0, 0))
+HANDLERS(eot, (void), (struct mf_reader *r),
+	event(0x2f, time, 0, 0, 0, 0))
+HANDLERS(tempo, (long t), (struct mf_reader *r, mf_tempo_t t),
+	event(0x51, time, 1, t, 0, 0))
+HANDLERS(keysig, (int s, int m), (struct mf_reader *r, int s, int m),
+	event(0x59, time, 2, s, m, 0))
+HANDLERS(timesig, (int nn, int dd, int cc, int bb),
+	(struct mf_reader *r, int nn, int dd, int cc, int bb),
+	(event(0x58, time, 2, nn, dd, 0), event(0x58, time, 2, cc, bb, 0)))
+HANDLERS(smpte, (int hr, int mn, int se, int fr, int ff),
+	(struct mf_reader *r, int hr, int mn, int se, int fr, int ff),
+	(event(0x54, time, 3, hr, mn, se), event(0x54, time, 2, fr, ff, 0)))
+
+/* those that aren’t given the time */
+
+static int
+o_header(int format, int ntrks, int division) {
+    return event(0, 0, 3, format, ntrks, division);
+}
+
+static void
+n_header(struct mf_reader *r, int format, int ntrks, int division) {
+    (void) r;
+    event(0, 0, 3, format, ntrks, division);
+}
+
+static int
+o_starttrack(void) {
+    return event(1, 0, 0, 0, 0, 0);
+}
+
+static void
+n_starttrack(struct mf_reader *r) {
+    (void) r;
+    event(1, 0, 0, 0, 0, 0);
+}
+
+/* the old reader, from a buffer */
+
+static const mf_data_t *Opos, *Oend;
+
+static int
+o_getc(void) {
+    return Opos < Oend ? *Opos++ : EOF;
+}
+
+static int
+o_error(char *s) {
+    fprintf(stderr, "origbench: old reader: %s\n", s);
+    return(0);
+}
+
+static void
+oldread(const mf_data_t *buf, mf_size_t len) {
+    orig_Mf_getc = o_getc;
+    orig_Mf_error = o_error;
+    orig_Mf_header = o_header;
+    orig_Mf_starttrack = o_starttrack;
+    orig_Mf_endtrack = o_endtrack;
+    orig_Mf_on = o_on;
+    orig_Mf_off = o_off;
+    orig_Mf_pressure = o_pressure;
+    orig_Mf_parameter = o_parameter;
+    orig_Mf_pitchbend = o_pitchbend;
+    orig_Mf_program = o_program;
+    orig_Mf_chanpressure = o_chanpressure;
+    orig_Mf_sysex = o_sysex;
+    orig_Mf_arbitrary = o_arbitrary;
+    orig_Mf_sqspecific = o_sqspecific;
+    orig_Mf_metamisc = o_metamisc;
+    orig_Mf_text = o_text;
+    orig_Mf_seqnum = o_seqnum;
+    orig_Mf_eot = o_eot;
+    orig_Mf_tempo = o_tempo;
+    orig_Mf_keysig = o_keysig;
+    orig_Mf_timesig = o_timesig;
+    orig_Mf_smpte = o_smpte;
+    Opos = buf;
+    Oend = buf + len;
+    orig_mfread();
+}
+
+/* the library’s reader */
+
+static void
+n_error(struct mf_reader *r, char *s) {
+    (void) r;
+    fprintf(stderr, "origbench: library reader: %s\n", s);
+}
+
+static void
+newread(const mf_data_t *buf, mf_size_t len) {
+    struct mf_reader r;
+
+    mf_reader_init(&r);
+    r.Mf_rerror = n_error;
+    r.Mf_header = n_header;
+    r.Mf_starttrack = n_starttrack;
+    r.Mf_endtrack = n_endtrack;
+    r.Mf_on = n_on;
+    r.Mf_off = n_off;
+    r.Mf_pressure = n_pressure;
+    r.Mf_parameter = n_parameter;
+    r.Mf_pitchbend = n_pitchbend;
+    r.Mf_program = n_program;
+    r.Mf_chanpressure = n_chanpressure;
+    r.Mf_sysex = n_sysex;
+    r.Mf_arbitrary = n_arbitrary;
+    r.Mf_sqspecific = n_sqspecific;
+    r.Mf_metamisc = n_metamisc;
+    r.Mf_text = n_text;
+    r.Mf_seqnum = n_seqnum;
+    r.Mf_eot = n_eot;
+    r.Mf_tempo = n_tempo;
+    r.Mf_keysig = n_keysig;
+    r.Mf_timesig = n_timesig;
+    r.Mf_smpte = n_smpte;
+    mfread_buf_r(&r, buf, len);
+    mf_reader_free(&r);
+}
+
+/*
+ * Encoding: the file’s events, with their payloads copied out, for
+ * both writers to put back together.
+ */
+
+struct song {
+    int format, ntracks, division;
+    struct mf_event *ev;
+    long nev, evsize;
+    long *start;		/* each track’s first event, and nev */
+    char *payload;
+    mf_size_t pleng, psize;
+    mf_data_t arb[65536 + 1];	/* an arbitrary event, with its 0xf7 */
+};
+
+static struct song Song;
+
+static void
+songheader(struct mf_reader *r, int format, int ntrks, int division) {
+    struct song *s = r->data;
+
+    s->format = format;
+    s->ntracks = ntrks;
+    s->division = division;
+    s->start = calloc(ntrks + 1, sizeof(*s->start));
+}
+
+static void
+songtrack(struct mf_reader *r) {
+    struct song *s = r->data;
+
+    if (r->track <= s->ntracks)
+        s->start[r->track - 1] = s->nev;
+}
+
+static void
+songevents(struct mf_reader *r, const struct mf_event *ev, int n,
+        const char *payload) {
+    struct song *s = r->data;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (s->nev == s->evsize) {
+            s->evsize = s->evsize ? 2 * s->evsize : 4096;
+            s->ev = realloc(s->ev, s->evsize * sizeof(*s->ev));
+        }
+        while (s->pleng + ev[i].leng > s->psize) {
+            s->psize = s->psize ? 2 * s->psize : 65536;
+            s->payload = realloc(s->payload, s->psize);
+        }
+        if (s->ev == NULL || s->payload == NULL) {
+            fprintf(stderr, "origbench: out of memory\n");
+            exit(1);
+        }
+        s->ev[s->nev] = ev[i];
+        s->ev[s->nev].offset = s->pleng;
+        memcpy(s->payload + s->pleng, payload + ev[i].offset, ev[i].leng);
+        s->pleng += ev[i].leng;
+        s->nev++;
+    }
+}
+
+static int
+decode(struct song *s, const mf_data_t *buf, mf_size_t len) {
+    static struct mf_event events[1024];
+    struct mf_reader r;
+    int ret;
+
+    memset(s, 0, offsetof(struct song, arb));
+    mf_reader_init(&r);
+    r.Mf_header = songheader;
+    r.Mf_starttrack = songtrack;
+    r.Mf_events = songevents;
+    r.Mf_rerror = n_error;
+    r.events = events;
+    r.maxevents = sizeof(events) / sizeof(events[0]);
+    r.noexit = 1;
+    r.data = s;
+    ret = mfread_buf_r(&r, buf, len);
+    mf_reader_free(&r);
+    if (ret < 0 || s->start == NULL)
+        return(-1);
+    s->start[s->ntracks] = s->nev;
+    return(0);
+}
+
+/* write a track’s events with w, or the old writer if w is NULL */
+static void
+puttrack(struct mf_writer *w, int track) {
+    struct song *s = &Song;
+    struct mf_event *e, *end;
+    mf_data_t *p, data[2];
+    mf_deltat_t delta, last = 0;
+    int n;
+
+    if (track < 0 || track >= s->ntracks)
+        return;
+    end = s->ev + s->start[track + 1];
+    for (e = s->ev + s->start[track]; e < end; e++) {
+        p = (mf_data_t *)s->payload + e->offset;
+        delta = e->time - last;
+        last = e->time;
+        switch (e->status) {
+        case 0xff:
+            if (w)
+                mf_w_meta_event_r(w, delta, e->data1, p, e->leng);
+            else
+                orig_mf_w_meta_event(delta, e->data1, p, e->leng);
+            break;
+        case 0xf7:
+            s->arb[0] = 0xf7;
+            memcpy(s->arb + 1, p, e->leng);
+            p = s->arb;
+            /* fall through */
+        case 0xf0:
+            n = e->leng + (e->status == 0xf7);
+            if (w)
+                mf_w_sysex_event_r(w, delta, p, n);
+            else
+                orig_mf_w_sysex_event(delta, p, n);
+            break;
+        default:
+            data[0] = e->data1;
+            data[1] = e->data2;
+            n = (e->status & 0xe0) == 0xc0 ? 1 : 2;
+            if (w)
+                mf_w_midi_event_r(w, delta, e->status & 0xf0,
+                        e->status & 0xf, data, n);
+            else
+                orig_mf_w_midi_event(delta, e->status & 0xf0,
+                        e->status & 0xf, data, n);
+        }
+    }
+}
+
+/* the old writer, to a memory stream */
+
+static FILE *Ofp;
+static char *Obuf;
+static size_t Oleng;
+
+static int
+o_putc(int c) {
+    return putc(c, Ofp);
+}
+
+static int
+o_wtrack(int track) {
+    puttrack(NULL, track);
+    return(0);
+}
+
+static int
+oldwrite(void) {
+    free(Obuf);
+    Obuf = NULL;
+    if ((Ofp = open_memstream(&Obuf, &Oleng)) == NULL)
+        return(-1);
+    orig_Mf_putc = o_putc;
+    orig_Mf_wtrack = o_wtrack;
+    orig_Mf_RunStat = 1;
+    orig_mfwrite(Song.format, Song.ntracks, Song.division, Ofp);
+    return fclose(Ofp) == 0 ? 0 : -1;
+}
+
+/* the library’s writer, to a growing buffer */
+
+static mf_data_t *Nbuf;
+static mf_size_t Nleng, Nsize;
+
+static int
+n_putbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    mf_data_t *more;
+
+    (void) w;
+    if (Nleng + size > Nsize) {
+        do
+            Nsize = Nsize ? 2 * Nsize : 65536;
+        while (Nleng + size > Nsize);
+        if ((more = realloc(Nbuf, Nsize)) == NULL)
+            return(-1);
+        Nbuf = more;
+    }
+    memcpy(Nbuf + Nleng, buf, size);
+    Nleng += size;
+    return(size);
+}
+
+static void
+n_wtrack(struct mf_writer *w) {
+    puttrack(w, w->track - 1);
+}
+
+static int
+newwrite(void) {
+    struct mf_writer w;
+    int ret;
+
+    Nleng = 0;
+    mf_writer_init(&w);
+    w.Mf_putbuf = n_putbuf;
+    w.Mf_wtrack = n_wtrack;
+    w.runstat = 1;
+    w.noexit = 1;
+    ret = mfwrite_r(&w, Song.format, Song.ntracks, Song.division, NULL);
+    mf_writer_free(&w);
+    return(ret);
+}
+
+/*
+ * Timing.  Each is run on the file until it has had at least three
+ * goes and a quarter of a second; the best go counts.
+ */
+
+static const mf_data_t *Buf;
+static mf_size_t Leng;
+
+static int
+runoldread(void) {
+    oldread(Buf, Leng);
+    return(0);
+}
+
+static int
+runnewread(void) {
+    newread(Buf, Leng);
+    return(0);
+}
+
+static double
+timeit(int (*run)(void)) {
+    double t, best = 0, start = now();
+    int n;
+
+    for (n = 0; n < 3 || now() - start < 0.25; n++) {
+        t = now();
+        if (run() != 0)
+            return(-1);
+        t = now() - t;
+        if (best == 0 || t < best)
+            best = t;
+    }
+    return(best);
+}
+
+static mf_data_t *
+readfile(const char *name, mf_size_t *leng) {
+    FILE *fp = fopen(name, "rb");
+    mf_data_t *buf = NULL, *more;
+    size_t n, size = 0;
+
+    *leng = 0;
+    if (fp == NULL) {
+        perror(name);
+        return(NULL);
+    }
+    do {
+        if (*leng == size) {
+            size = size ? 2 * size : 65536;
+            if ((more = realloc(buf, size)) == NULL) {
+                fprintf(stderr, "origbench: out of memory\n");
+                exit(1);
+            }
+            buf = more;
+        }
+        n = fread(buf + *leng, 1, size - *leng, fp);
+        *leng += n;
+    } while (n > 0);
+    fclose(fp);
+    return(buf);
+}
+
+int
+main(int argc, char **argv) {
+    double mb, ort, nrt, owt, nwt;
+    unsigned long ohash;
+    long oevents;
+    mf_data_t *buf;
+    int i, status = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: origbench midifile...\n");
+        return 1;
+    }
+
+    printf("%-24s %6s %9s  %-23s  %-23s\n", "", "", "",
+            "decode MB/s", "encode MB/s");
+    printf("%-24s %6s %9s ", "file", "MB", "events");
+    for (i = 0; i < 2; i++)
+        printf(" %7s %7s %7s", "old", "new", "new/old");
+    printf("\n");
+
+    for (i = 1; i < argc; i++) {
+        if ((buf = readfile(argv[i], &Leng)) == NULL)
+            continue;
+        Buf = buf;
+        mb = Leng / 1e6;
+
+        Check = 1;
+        Hash = Events = 0;
+        oldread(Buf, Leng);
+        ohash = Hash;
+        oevents = Events;
+        Hash = Events = 0;
+        newread(Buf, Leng);
+        if (Hash != ohash || Events != oevents) {
+            fprintf(stderr, "origbench: %s: decoded events differ\n",
+                    argv[i]);
+            status = 1;
+        }
+        Check = 0;
+        ort = timeit(runoldread);
+        nrt = timeit(runnewread);
+
+        if (decode(&Song, Buf, Leng) < 0) {
+            fprintf(stderr, "origbench: %s: can’t be decoded\n", argv[i]);
+            status = 1;
+            free(buf);
+            continue;
+        }
+        owt = timeit(oldwrite);
+        nwt = timeit(newwrite);
+        if (owt < 0 || nwt < 0) {
+            fprintf(stderr, "origbench: %s: can’t be encoded\n", argv[i]);
+            status = 1;
+        } else if (Oleng != Nleng || memcmp(Obuf, Nbuf, Nleng) != 0) {
+            fprintf(stderr, "origbench: %s: encoded files differ\n",
+                    argv[i]);
+            status = 1;
+        }
+
+        printf("%-24s %6.2f %9ld  %7.1f %7.1f %7.2f  %7.1f %7.1f %7.2f\n",
+                argv[i], mb, oevents, mb / ort, mb / nrt, ort / nrt,
+                mb / owt, mb / nwt, owt / nwt);
+        fflush(stdout);
+
+        free(Song.ev);
+        free(Song.payload);
+        free(Song.start);
+        free(buf);
+    }
+    free(Obuf);
+    free(Nbuf);
+    return status;
+}
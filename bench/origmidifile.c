@@ -0,0 +1,66 @@
+/*
+ * origmidifile
+ *
+ * The 1991 midifile.c from orig/, for origbench.  Its public names are
+ * given an orig_ prefix so that it can be linked with the library,
+ * which still has most of them, and the static functions it uses before
+ * defining them are declared first, as compilers now want.  It is K&R
+ * C, and is compiled without the warnings.
+ *
+ * Its reader counted on the Mf_toberead in "Mf_toberead - readvarinum()"
+ * being fetched after the call, which changes it; gcc since 4 fetches it
+ * first (see get_lookfor() in midifile_read.c), and every meta or sysex
+ * event comes out a byte short.  The Makefile makes origfixed.c, a copy
+ * with only that put right, for this to include.
+ */
+
+#define Mf_RunStat		orig_Mf_RunStat
+#define Mf_arbitrary		orig_Mf_arbitrary
+#define Mf_chanpressure		orig_Mf_chanpressure
+#define Mf_currtime		orig_Mf_currtime
+#define Mf_endtrack		orig_Mf_endtrack
+#define Mf_eot			orig_Mf_eot
+#define Mf_error		orig_Mf_error
+#define Mf_getc			orig_Mf_getc
+#define Mf_header		orig_Mf_header
+#define Mf_keysig		orig_Mf_keysig
+#define Mf_metamisc		orig_Mf_metamisc
+#define Mf_nomerge		orig_Mf_nomerge
+#define Mf_off			orig_Mf_off
+#define Mf_on			orig_Mf_on
+#define Mf_parameter		orig_Mf_parameter
+#define Mf_pitchbend		orig_Mf_pitchbend
+#define Mf_pressure		orig_Mf_pressure
+#define Mf_program		orig_Mf_program
+#define Mf_putc			orig_Mf_putc
+#define Mf_seqnum		orig_Mf_seqnum
+#define Mf_smpte		orig_Mf_smpte
+#define Mf_sqspecific		orig_Mf_sqspecific
+#define Mf_starttrack		orig_Mf_starttrack
+#define Mf_sysex		orig_Mf_sysex
+#define Mf_tempo		orig_Mf_tempo
+#define Mf_text			orig_Mf_text
+#define Mf_timesig		orig_Mf_timesig
+#define Mf_wtempotrack		orig_Mf_wtempotrack
+#define Mf_wtrack		orig_Mf_wtrack
+#define WriteVarLen		orig_WriteVarLen
+#define eputc			orig_eputc
+#define mf_sec2ticks		orig_mf_sec2ticks
+#define mf_ticks2sec		orig_mf_ticks2sec
+#define mf_w_header_chunk	orig_mf_w_header_chunk
+#define mf_w_meta_event		orig_mf_w_meta_event
+#define mf_w_midi_event		orig_mf_w_midi_event
+#define mf_w_sysex_event	orig_mf_w_sysex_event
+#define mf_w_tempo		orig_mf_w_tempo
+#define mf_w_track_chunk	orig_mf_w_track_chunk
+#define mferror			orig_mferror
+#define mfread			orig_mfread
+#define mfwrite			orig_mfwrite
+#define midifile		orig_midifile
+#define write16bit		orig_write16bit
+#define write32bit		orig_write32bit
+
+static int readtrack(), badbyte(), metaevent(), sysex(), chanmessage();
+static int msginit(), msgleng(), msgadd(), biggermsg();
+
+#include "origfixed.c"
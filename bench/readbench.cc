@@ -0,0 +1,124 @@
+/*
+ * readbench
+ *
+ * Compare the speed of decoding MIDI files through the C callbacks of
+ * midifile_read.c (mfread_buf_r) and the C++ template reader of
+ * midifile_read.hpp, with the same handlers: a count of note on events
+ * and a sum of their pitches, so that each has something to do.
+ *
+ * Usage: readbench [-n MB] midifile...
+ *
+ * Each file is decoded repeatedly until about MB megabytes (default
+ * 200) have been read by each reader.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "midifile.h"
+#include "midifile_read.hpp"
+
+static long Notes, Sum;
+
+/* the C side */
+
+static void
+c_on(struct mf_reader *r, int chan, int pitch, int vol) {
+    (void) r; (void) chan;
+    if (vol > 0) {
+	Notes++;
+	Sum += pitch;
+    }
+}
+
+/* the C++ side */
+
+struct counter : mf::reader<counter> {
+    void on(int chan, int pitch, int vol) {
+	(void) chan;
+	if (vol > 0) {
+	    Notes++;
+	    Sum += pitch;
+	}
+    }
+};
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool
+readfile(const char *name, std::vector<mf_data_t> &buf) {
+    FILE *fp = std::fopen(name, "rb");
+    mf_data_t chunk[65536];
+    size_t n;
+
+    if (fp == NULL) {
+	std::perror(name);
+	return false;
+    }
+    buf.clear();
+    while ((n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0)
+	buf.insert(buf.end(), chunk, chunk + n);
+    std::fclose(fp);
+    return true;
+}
+
+int
+main(int argc, char **argv) {
+    double mb = 200;
+    int i;
+
+    if (argc > 2 && std::strcmp(argv[1], "-n") == 0) {
+	mb = std::atof(argv[2]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 2) {
+	std::fprintf(stderr, "Usage: readbench [-n MB] midifile...\n");
+	return 1;
+    }
+
+    std::printf("%-24s %10s %10s %8s\n", "file", "C MB/s", "C++ MB/s", "ratio");
+    for (i = 1; i < argc; i++) {
+	std::vector<mf_data_t> buf;
+	struct mf_reader r;
+	counter cxx;
+	long n, reps, cnotes;
+	double t, ct, cxxt;
+
+	if (!readfile(argv[i], buf) || buf.empty())
+	    continue;
+	reps = (long)(mb * 1e6 / buf.size()) + 1;
+
+	mf_reader_init(&r);
+	r.Mf_on = c_on;
+	Notes = Sum = 0;
+	t = now();
+	for (n = 0; n < reps; n++)
+	    mfread_buf_r(&r, &buf[0], buf.size());
+	ct = now() - t;
+	cnotes = Notes;
+	mf_reader_free(&r);
+
+	Notes = Sum = 0;
+	t = now();
+	for (n = 0; n < reps; n++)
+	    cxx.read(&buf[0], buf.size());
+	cxxt = now() - t;
+	if (Notes != cnotes)
+	    std::fprintf(stderr, "%s: note counts differ\n", argv[i]);
+
+	std::printf("%-24s %10.1f %10.1f %8.2f\n", argv[i],
+		buf.size() * reps / ct / 1e6, buf.size() * reps / cxxt / 1e6,
+		ct / cxxt);
+    }
+    return 0;
+}
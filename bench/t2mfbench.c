@@ -0,0 +1,147 @@
+/*
+ * t2mfbench
+ *
+ * Time t2mf on a large generated text file and report events per
+ * second.  The text is of the kind mf2t writes: note on and off pairs
+ * with some controller, pitch bend, program change, tempo and text
+ * events, spread over several tracks.
+ *
+ * Usage: t2mfbench [-n events] [-t tracks] [-a args] [t2mf...]
+ *
+ * Each t2mf program named (default ./t2mf) translates the file three
+ * times, and the best time is reported, so that an older build can be
+ * compared with the current one.  The args (default "-j 1") are given
+ * to each; use -a "" for a t2mf without -j.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* write ntracks tracks of about nevents events in all to fp */
+static long
+generate(FILE *fp, long nevents, int ntracks) {
+    long per = nevents / ntracks, n, count = 0;
+    unsigned long seed = 1;
+    int trk, chan, note;
+    long time;
+
+    fprintf(fp, "MFile 1 %d 384\n", ntracks);
+    for (trk = 0; trk < ntracks; trk++) {
+	chan = trk % 16 + 1;
+	time = 0;
+	fprintf(fp, "MTrk\n");
+	fprintf(fp, "0 Meta TrkName \"Track %d\"\n", trk);
+	fprintf(fp, "0 PrCh ch=%d p=%d\n", chan, trk % 128);
+	for (n = 2; n + 2 < per; n += 2) {
+	    seed = seed * 1103515245 + 12345;
+	    note = 36 + (seed >> 16) % 48;
+	    switch ((seed >> 8) % 16) {
+	    case 0:
+		fprintf(fp, "%ld Par ch=%d c=7 v=%lu\n", time, chan,
+			(seed >> 4) % 128);
+		break;
+	    case 1:
+		fprintf(fp, "%ld Pb ch=%d v=%lu\n", time, chan,
+			(seed >> 4) % 16384);
+		break;
+	    case 2:
+		if (trk == 0) {
+		    fprintf(fp, "%ld Tempo %lu\n", time,
+			    400000 + (seed >> 4) % 200000);
+		    break;
+		}
+		/* FALLTHROUGH */
+	    default:
+		fprintf(fp, "%ld On ch=%d n=%d v=%lu\n", time, chan, note,
+			1 + (seed >> 4) % 127);
+		break;
+	    }
+	    time += 96;
+	    fprintf(fp, "%ld Off ch=%d n=%d v=0\n", time, chan, note);
+	}
+	fprintf(fp, "%ld Meta TrkEnd\nTrkEnd\n", time);
+	count += n + 1;
+    }
+    return(count);
+}
+
+int
+main(int argc, char **argv) {
+    static char deflt[] = "./t2mf";
+    static char *defprogs[] = { deflt, NULL };
+    char name[] = "/tmp/t2mfbenchXXXXXX";
+    char cmd[1024];
+    char *args = "-j 1";
+    long nevents = 2000000;
+    int ntracks = 16;
+    double t, best;
+    char **progs;
+    FILE *fp;
+    int c, fd, i, status = 0;
+
+    while ((c = getopt(argc, argv, "n:t:a:")) != -1) {
+	switch (c) {
+	case 'n':
+	    nevents = atol(optarg);
+	    break;
+	case 't':
+	    ntracks = atoi(optarg);
+	    break;
+	case 'a':
+	    args = optarg;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: t2mfbench [-n events] [-t tracks] "
+		    "[-a args] [t2mf...]\n");
+	    return 1;
+	}
+    }
+    if (ntracks < 1)
+	ntracks = 1;
+    if (nevents < 4 * ntracks)
+	nevents = 4 * ntracks;
+    progs = optind < argc ? argv + optind : defprogs;
+
+    if ((fd = mkstemp(name)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+	perror(name);
+	return 1;
+    }
+    nevents = generate(fp, nevents, ntracks);
+    if (fclose(fp) != 0) {
+	perror(name);
+	unlink(name);
+	return 1;
+    }
+
+    printf("%-24s %10s %14s\n", "t2mf", "seconds", "events/s");
+    for (; *progs; progs++) {
+	snprintf(cmd, sizeof(cmd), "%s %s %s /dev/null", *progs, args, name);
+	best = 0;
+	for (i = 0; i < 3; i++) {
+	    t = now();
+	    if (system(cmd) != 0) {
+		fprintf(stderr, "%s failed\n", cmd);
+		status = 1;
+		break;
+	    }
+	    t = now() - t;
+	    if (best == 0 || t < best)
+		best = t;
+	}
+	if (i == 3)
+	    printf("%-24s %10.3f %14.0f\n", *progs, best, nevents / best);
+    }
+    unlink(name);
+    return status;
+}
@@ -2,6 +2,7 @@
 #define MIDIFILE_H
 
 #include <stdint.h>
+#include <setjmp.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -57,6 +58,7 @@ typedef int32_t mf_varinum_t;		/* internal */
 /* functions for writing a MIDI file */
 #define MIDIFILE_WRITE_FUNCTIONS \
     MIDIFILE_FUNC(int,Mf_putc, (int)) /* stdio getchar signature */ \
+    MIDIFILE_FUNC(int,Mf_putbuf, (const mf_data_t *buf, mf_size_t size)) \
     MIDIFILE_FUNC(void,Mf_wtrack, (void)) \
     MIDIFILE_FUNC(void,Mf_wtempotrack, (int)) \
     MIDIFILE_FUNC(void,Mf_werror, (char *s))
@@ -73,8 +75,184 @@ MIDIFILE_PUBLIC extern int Mf_nomerge;
 MIDIFILE_PUBLIC extern int Mf_trace_output; /* PLB */
 
 MIDIFILE_PUBLIC void mfread(void);
+MIDIFILE_PUBLIC void mfread_buf(const mf_data_t *buf, mf_size_t len);
 MIDIFILE_PUBLIC void midifile(void);
 
+/*
+ * Reentrant reading: a struct mf_reader carries its own handlers (as
+ * the Mf_* read functions, but passed the reader first), a pointer for
+ * the caller’s use and all parse state, so several files can be read
+ * at once.  mfread() and mfread_buf() are wrappers around a static one.
+ */
+struct mf_reader;
+
+/*
+ * Errors are passed to Mf_rerror (Mf_werror), and then the program
+ * exits, unless noexit is set in the reader (writer): then the entry
+ * point that was called returns at once, with -1 (or 0 for those that
+ * return a length) and what went wrong in err.  Writing, that may be
+ * from inside Mf_wtrack, which is left unfinished; outside it the
+ * mf_w_*_r() event functions are entry points too.  err is filled in
+ * before Mf_rerror (Mf_werror) is called, so it may use it as well.
+ */
+struct mf_error {
+    char reason[64];		/* for Mf_rerror or Mf_werror, or "" */
+    mf_size_t offset;		/* bytes of the file before the error */
+    int track;			/* 1 for the first track, 0 the header */
+};
+
+/*
+ * Batch reading: with Mf_events set and events pointing at an array of
+ * maxevents of these, the events of a track are stored in the array
+ * instead of being passed one at a time to Mf_on, Mf_text and the
+ * rest, and Mf_events is called each time the array fills and at the
+ * end of each track.  Meta events have status 0xff and their type in
+ * data1; sysex (0xf0, including the 0xf0) and arbitrary (0xf7) events
+ * have only a payload, which is leng bytes at offset in the payload
+ * area passed along with the array.
+ */
+struct mf_event {
+    mf_deltat_t time;		/* ticks since the start of the track */
+    mf_data_t status;		/* status byte, with the channel */
+    mf_data_t data1;		/* first data byte, or meta type */
+    mf_data_t data2;		/* second data byte, if any */
+    mf_size_t offset;		/* payload offset */
+    mf_size_t leng;		/* payload length */
+};
+
+/*
+ * Statistics: with stats pointing at one of these, a reader counts the
+ * events it passes on, the bytes it reads and the times its buffers
+ * grow, and a writer the events it writes, the bytes it passes on and
+ * the times outbuf grows.  The counts are added to what is there, so
+ * one struct may total several files, but only one thread may count in
+ * it at a time.
+ */
+struct mf_stats {
+    uint64_t events;		/* all of them */
+    uint64_t chan[7][16];	/* channel messages: [0] 0x80 to [6] 0xe0 */
+    uint64_t meta;		/* meta events, end of track included */
+    uint64_t sysex;		/* sysex, merged or not */
+    uint64_t arbitrary;		/* 0xf7 events other than continuations */
+    uint64_t tracks;
+    uint64_t bytes;		/* of the file */
+    uint64_t reallocs;		/* of message, payload or output buffers */
+};
+
+MIDIFILE_PUBLIC void mf_stats_count(struct mf_stats *s, int status);
+MIDIFILE_PUBLIC void mf_stats_add(struct mf_stats *to,
+	const struct mf_stats *from);
+MIDIFILE_PUBLIC void mf_stats_print(FILE *fp, const char *prefix,
+	const struct mf_stats *s);
+
+#define MIDIFILE_READER_FUNCTIONS \
+    MIDIFILE_RFUNC(int, Mf_getc, (struct mf_reader *r)) \
+    MIDIFILE_RFUNC(void,Mf_header, (struct mf_reader *r, \
+		int format, int ntrks, int division)) \
+    MIDIFILE_RFUNC(void,Mf_starttrack, (struct mf_reader *r)) \
+    MIDIFILE_RFUNC(void,Mf_endtrack, (struct mf_reader *r)) \
+    MIDIFILE_RFUNC(void,Mf_on, (struct mf_reader *r, \
+		int chan, int pitch, int vol)) \
+    MIDIFILE_RFUNC(void,Mf_off, (struct mf_reader *r, \
+		int chan, int pitch, int vol)) \
+    MIDIFILE_RFUNC(void,Mf_pressure, (struct mf_reader *r, \
+		int chan, int pitch, int press)) \
+    MIDIFILE_RFUNC(void,Mf_parameter, (struct mf_reader *r, \
+		int chan, int control, int value)) \
+    MIDIFILE_RFUNC(void,Mf_pitchbend, (struct mf_reader *r, \
+		int chan, int lsb, int msb)) \
+    MIDIFILE_RFUNC(void,Mf_program, (struct mf_reader *r, \
+		int chan, int program)) \
+    MIDIFILE_RFUNC(void,Mf_chanpressure, (struct mf_reader *r, \
+		int chan, int press)) \
+    MIDIFILE_RFUNC(void,Mf_sysex, (struct mf_reader *r, \
+		int leng, char *mess)) \
+    MIDIFILE_RFUNC(void,Mf_metamisc, (struct mf_reader *r, \
+		int type, int leng, char *mess)) \
+    MIDIFILE_RFUNC(void,Mf_sqspecific, (struct mf_reader *r, \
+		int leng, char *mess)) \
+    MIDIFILE_RFUNC(void,Mf_seqnum, (struct mf_reader *r, int num)) \
+    MIDIFILE_RFUNC(void,Mf_text, (struct mf_reader *r, \
+		int type, int leng, char *mess)) \
+    MIDIFILE_RFUNC(void,Mf_eot, (struct mf_reader *r)) \
+    MIDIFILE_RFUNC(void,Mf_timesig, (struct mf_reader *r, \
+		int nn, int dd, int cc, int bb)) \
+    MIDIFILE_RFUNC(void,Mf_smpte, (struct mf_reader *r, \
+		int hr, int mn, int se, int fr, int ff)) \
+    MIDIFILE_RFUNC(void,Mf_tempo, (struct mf_reader *r, mf_tempo_t tempo)) \
+    MIDIFILE_RFUNC(void,Mf_keysig, (struct mf_reader *r, int sf, int mi)) \
+    MIDIFILE_RFUNC(void,Mf_arbitrary, (struct mf_reader *r, \
+		int leng, char *mess)) \
+    MIDIFILE_RFUNC(void,Mf_rerror, (struct mf_reader *r, char *s)) \
+    MIDIFILE_RFUNC(void,Mf_events, (struct mf_reader *r, \
+		const struct mf_event *ev, int n, const char *payload))
+
+struct mf_reader {
+#define MIDIFILE_RFUNC(RET,NAME,ARGS) RET (*NAME)ARGS;
+    MIDIFILE_READER_FUNCTIONS
+#undef MIDIFILE_RFUNC
+    void *data;			/* for the caller’s use */
+    int nomerge;		/* as Mf_nomerge */
+    mf_deltat_t currtime;	/* as Mf_currtime */
+    struct mf_event *events;	/* batch array for Mf_events */
+    int maxevents;		/* and its size */
+    int noexit;			/* 1 => return errors, don’t exit */
+    struct mf_error err;	/* why the last call failed */
+    mf_size_t offset;		/* bytes of the file read */
+    int track;			/* tracks begun */
+    struct mf_stats *stats;	/* what to count in, or NULL */
+
+    /* private */
+    mf_ssize_t toberead;	/* bytes left in the current chunk */
+    int inbuf;			/* reading from bufp rather than Mf_getc */
+    const mf_data_t *bufstart;	/* the buffer being read */
+    const mf_data_t *bufp;	/* next byte to read */
+    const mf_data_t *bufend;	/* end of buffer */
+    int catching;		/* in an entry point, with noexit */
+    jmp_buf jump;		/* and where it returns on error */
+    char *msgbuff;		/* message buffer */
+    int msgsize;		/* size of currently allocated msgbuff */
+    int msgindex;		/* index of next available location */
+    int batch;			/* storing this track’s events in events */
+    int nevents;		/* events stored */
+    char *evdata;		/* their payloads */
+    mf_size_t evdatasize;	/* size of currently allocated evdata */
+    mf_size_t evdataleng;	/* bytes used in evdata */
+    int pstate;			/* mfread_feed_r(): what the next byte is */
+    int pchunks;		/* chunks begun */
+    int pgot;			/* bytes of this part had */
+    uint32_t pval;		/* number being read */
+    mf_data_t pbytes[6];	/* header or channel message data */
+    int pneed;			/* channel message data bytes */
+    int pstatus;		/* running status */
+    int psysex;			/* 1 if last message was an unfinished sysex */
+    int pc;			/* meta or sysex event status byte */
+    int ptype;			/* meta event type */
+    mf_ssize_t pleft;		/* bytes of the event still to come */
+};
+
+MIDIFILE_PUBLIC void mf_reader_init(struct mf_reader *r);
+MIDIFILE_PUBLIC void mf_reader_free(struct mf_reader *r);
+MIDIFILE_PUBLIC int mfread_r(struct mf_reader *r);
+MIDIFILE_PUBLIC int mfread_buf_r(struct mf_reader *r,
+	const mf_data_t *buf, mf_size_t len);
+MIDIFILE_PUBLIC mf_size_t mfread_header_buf_r(struct mf_reader *r,
+	const mf_data_t *buf, mf_size_t len);
+MIDIFILE_PUBLIC mf_size_t mfread_track_buf_r(struct mf_reader *r,
+	const mf_data_t *buf, mf_size_t len);
+
+/*
+ * Push reading, for a file that arrives in pieces: pass each piece to
+ * mfread_feed_r() as it comes, and call mfread_finish_r() at the end.
+ * Only a meta or sysex event split between pieces is copied.
+ * mfread_feed_tracks_r() is for track chunks with no header before them.
+ */
+MIDIFILE_PUBLIC int mfread_feed_r(struct mf_reader *r,
+	const mf_data_t *buf, mf_size_t len);
+MIDIFILE_PUBLIC int mfread_feed_tracks_r(struct mf_reader *r,
+	const mf_data_t *buf, mf_size_t len);
+MIDIFILE_PUBLIC int mfread_finish_r(struct mf_reader *r);
+
 /* definitions for MIDI file writing code */
 
 MIDIFILE_PUBLIC extern int Mf_RunStat;
@@ -82,6 +260,44 @@ MIDIFILE_PUBLIC float mf_ticks2sec(mf_ticks_t ticks, int division,
         mf_tempo_t tempo);
 MIDIFILE_PUBLIC mf_ticks_t mf_sec2ticks(float secs, int division,
         mf_tempo_t tempo);
+
+/*
+ * Tempo maps, for times in microseconds exactly rather than in float
+ * seconds at one tempo: add each Mf_tempo with its time in ticks (since
+ * the start of its track) and look ticks up in the map, or times.  Each
+ * segment holds its time since the start, so a lookup is a binary
+ * search and a multiply.  Times are kept in units of 1/scale µs, which
+ * is exact: µs per quarter note over division for ticks of a quarter
+ * note, and 1e6 over frames per second times ticks per frame (29 being
+ * 30000/1001) for SMPTE, where tempo doesn’t count.  Before the first
+ * Tempo it is 500000 (120 beats a minute).
+ */
+struct mf_tempo_seg {
+    mf_ticks_t tick;		/* where it starts */
+    mf_tempo_t tempo;		/* µs per quarter note from there on */
+    uint64_t time;		/* at tick, in units */
+};
+
+struct mf_tempo_map {
+    int division;		/* as in the header */
+    uint64_t scale;		/* units to the µs */
+    uint64_t step;		/* units per tick for SMPTE, else 0 */
+    struct mf_tempo_seg *segs;	/* in tick order, the first at tick 0 */
+    int nsegs;
+    int maxsegs;		/* allocated */
+};
+
+MIDIFILE_PUBLIC int mf_tempo_map_init(struct mf_tempo_map *m, int division);
+MIDIFILE_PUBLIC void mf_tempo_map_free(struct mf_tempo_map *m);
+MIDIFILE_PUBLIC int mf_tempo_map_add(struct mf_tempo_map *m,
+	mf_ticks_t tick, mf_tempo_t tempo);
+MIDIFILE_PUBLIC uint64_t mf_tempo_map_us(const struct mf_tempo_map *m,
+	mf_ticks_t tick, uint64_t *rem);
+MIDIFILE_PUBLIC uint64_t mf_tempo_map_next(const struct mf_tempo_map *m,
+	mf_ticks_t tick, int *seg, uint64_t *rem);
+MIDIFILE_PUBLIC mf_ticks_t mf_tempo_map_ticks(const struct mf_tempo_map *m,
+	uint64_t us);
+
 MIDIFILE_PUBLIC void mfwrite(int format, int ntracks, int division, FILE *fp);
 MIDIFILE_PUBLIC int mf_w_midi_event(mf_deltat_t delta_time,
         unsigned int type, unsigned int chan, mf_data_t *data,
@@ -93,6 +309,73 @@ MIDIFILE_PUBLIC int mf_w_sysex_event(mf_deltat_t delta_time,
 MIDIFILE_PUBLIC void mf_w_tempo(mf_deltat_t delta_time,
         mf_tempo_t tempo);
 
+/*
+ * Reentrant writing: a struct mf_writer carries its own handlers (as
+ * the Mf_* write functions, but passed the writer first), a pointer for
+ * the caller’s use and the running status state, so several files can
+ * be written at once.  mfwrite() and the mf_w_* functions are wrappers
+ * around a static one.
+ */
+struct mf_writer;
+
+#define MIDIFILE_WRITER_FUNCTIONS \
+    MIDIFILE_WFUNC(int,Mf_putc, (struct mf_writer *w, int c)) \
+    MIDIFILE_WFUNC(int,Mf_putbuf, (struct mf_writer *w, \
+		const mf_data_t *buf, mf_size_t size)) \
+    MIDIFILE_WFUNC(void,Mf_wtrack, (struct mf_writer *w)) \
+    MIDIFILE_WFUNC(void,Mf_wtempotrack, (struct mf_writer *w, int track)) \
+    MIDIFILE_WFUNC(void,Mf_werror, (struct mf_writer *w, char *s))
+
+struct mf_writer {
+#define MIDIFILE_WFUNC(RET,NAME,ARGS) RET (*NAME)ARGS;
+    MIDIFILE_WRITER_FUNCTIONS
+#undef MIDIFILE_WFUNC
+    void *data;			/* for the caller’s use */
+    int runstat;		/* as Mf_RunStat */
+    int trace_output;		/* as Mf_trace_output */
+    int noexit;			/* 1 => return errors, don’t exit */
+    struct mf_error err;	/* why the last call failed */
+    mf_size_t offset;		/* bytes of the file passed on */
+    int track;			/* tracks begun */
+    struct mf_stats *stats;	/* what to count in, or NULL */
+
+    /* private */
+    int catching;		/* in an entry point, with noexit */
+    jmp_buf jump;		/* and where it returns on error */
+    mf_ssize_t numbyteswritten;	/* bytes in the current track */
+    int laststat;		/* last status code */
+    int lastmeta;		/* last meta event type */
+    mf_data_t *outbuf;		/* output not yet passed on */
+    mf_size_t outsize;		/* size of currently allocated outbuf */
+    mf_size_t outleng;		/* bytes in outbuf */
+    mf_size_t trackat;		/* where in outbuf the track began */
+};
+
+MIDIFILE_PUBLIC void mf_writer_init(struct mf_writer *w);
+MIDIFILE_PUBLIC void mf_writer_free(struct mf_writer *w);
+MIDIFILE_PUBLIC int mfwrite_r(struct mf_writer *w,
+        int format, int ntracks, int division, FILE *fp);
+MIDIFILE_PUBLIC int mf_w_header_r(struct mf_writer *w,
+        int format, int ntracks, int division);
+MIDIFILE_PUBLIC int mf_w_track_r(struct mf_writer *w);
+/*
+ * With noexit set, an event written between mf_w_track_begin_r() and
+ * mf_w_track_end_r() that fails returns -1, and the track so far is
+ * dropped: begin it again.
+ */
+MIDIFILE_PUBLIC int mf_w_track_begin_r(struct mf_writer *w);
+MIDIFILE_PUBLIC int mf_w_track_end_r(struct mf_writer *w);
+MIDIFILE_PUBLIC int mf_w_midi_event_r(struct mf_writer *w,
+        mf_deltat_t delta_time, unsigned int type, unsigned int chan,
+        mf_data_t *data, mf_size_t size);
+MIDIFILE_PUBLIC int mf_w_meta_event_r(struct mf_writer *w,
+        mf_deltat_t delta_time, unsigned int type,
+        mf_data_t *data, mf_size_t size);
+MIDIFILE_PUBLIC int mf_w_sysex_event_r(struct mf_writer *w,
+        mf_deltat_t delta_time, mf_data_t *data, mf_size_t size);
+MIDIFILE_PUBLIC int mf_w_tempo_r(struct mf_writer *w,
+        mf_deltat_t delta_time, mf_tempo_t tempo);
+
 /* MIDI status commands most significant bit is 1 */
 #define note_off                0x80
 #define note_on                 0x90
@@ -67,43 +67,130 @@ MIDIFILE_PUBLIC int Mf_nomerge = 0;
 MIDIFILE_PUBLIC mf_deltat_t Mf_currtime = 0;
 
 /* private stuff */
-static mf_ssize_t Mf_toberead = 0;
+
+/*
+ * All parse state lives in a struct mf_reader (see midifile.h), so any
+ * number of files can be read at once.  mfread() and mfread_buf() use
+ * this one, with handlers that call the Mf_* function pointers above.
+ */
+static struct mf_reader Mf_reader;
 
 static void
-mferror(char *s) {
-    if (Mf_rerror)
-        Mf_rerror(s);
-    exit(1);
+mferror(struct mf_reader *r, char *s) {
+    snprintf(r->err.reason, sizeof(r->err.reason), "%s", s);
+    r->err.offset = r->offset;
+    if (r->inbuf)
+        r->err.offset += r->bufp - r->bufstart;
+    r->err.track = r->track;
+    if (r->Mf_rerror)
+        r->Mf_rerror(r, s);
+    if (!r->catching)
+        exit(1);
+    r->catching = 0;
+    r->inbuf = 0;
+    longjmp(r->jump, 1);
 }
 
+/*
+ * With noexit set, the entry points below catch errors here: mferror()
+ * longjmps back, and the entry point returns failure.
+ */
+#define CATCH(r, failure) \
+    memset(&(r)->err, 0, sizeof((r)->err)); \
+    if ((r)->noexit) { \
+        if (setjmp((r)->jump)) \
+            return(failure); \
+        (r)->catching = 1; \
+    }
+
 static void
-badbyte(int c) {
+badbyte(struct mf_reader *r, int c) {
     char buff[32];
 
     (void) sprintf(buff,"unexpected byte: %#02x",c);
-    mferror(buff);
+    mferror(r, buff);
 }
 
+/* the input ends too soon; it is all read, as egetc() would have */
+static void
+premature(struct mf_reader *r) {
+    r->bufp = r->bufend;
+    mferror(r, "premature EOF");
+}
+
+/* read a single character, EOF at end of input */
 static int
-egetc(void) {		/* read a single character and abort on EOF */
-    int c = Mf_getc();
+mgetc(struct mf_reader *r) {
+    int c;
+
+    if (r->inbuf)
+        return (r->bufp < r->bufend) ? *r->bufp++ : EOF;
+    if ((c = r->Mf_getc(r)) != EOF)
+        r->offset++;
+    return(c);
+}
 
-    if (c == EOF || feof(stdin))
-        mferror("premature EOF");
-    Mf_toberead--;
+static int
+egetc(struct mf_reader *r) {	/* read a single character and abort on EOF */
+    int c;
+
+    if (r->inbuf) {
+        if (r->bufp >= r->bufend)
+            mferror(r, "premature EOF");
+        c = *r->bufp++;
+    } else {
+        c = r->Mf_getc(r);
+        if (c == EOF)
+            mferror(r, "premature EOF");
+        r->offset++;
+    }
+    r->toberead--;
     return(c);
 }
 
 static mf_varinum_t
-readvarinum(void) {		    /* read a varying-length number */
+readvarinum(struct mf_reader *r) {	/* read a varying-length number */
     mf_varinum_t value;
     int c;
 
-    value = c = egetc();
+    value = c = egetc(r);
     if (c & 0x80) {
         value &= 0x7f;
         do {
-            c = egetc();
+            c = egetc(r);
+            value = (value << 7) + (c & 0x7f);
+        } while (c & 0x80);
+    }
+    return(value);
+}
+
+/*
+ * egetc() and readvarinum() for a track chunk that readtrack() has
+ * found to be all in the buffer, with at least EVENTHEAD bytes of it
+ * left: the bytes are taken without looking for the end of the buffer.
+ * EVENTHEAD is as far as an event goes before the rest of it is
+ * checked: four bytes of delta time and the status, then two data
+ * bytes, or a meta type and four bytes of length.  Numbers longer than
+ * four bytes go on through egetc().
+ */
+#define EVENTHEAD 10
+
+static int
+bgetc(struct mf_reader *r) {
+    r->toberead--;
+    return(*r->bufp++);
+}
+
+static mf_varinum_t
+breadvarinum(struct mf_reader *r) {
+    mf_varinum_t value;
+    int c, n = 1;
+
+    value = c = bgetc(r);
+    if (c & 0x80) {
+        value &= 0x7f;
+        do {
+            c = n++ < 4 ? bgetc(r) : egetc(r);
             value = (value << 7) + (c & 0x7f);
         } while (c & 0x80);
     }
@@ -127,69 +214,203 @@ to16bit(int c1, int c2) {
 }
 
 static int32_t
-read32bit(void) {
+read32bit(struct mf_reader *r) {
     int c1, c2, c3, c4;
 
-    c1 = egetc();
-    c2 = egetc();
-    c3 = egetc();
-    c4 = egetc();
+    if (r->inbuf && r->bufend - r->bufp >= 4) {
+        const mf_data_t *p = r->bufp;
+
+        r->bufp += 4;
+        r->toberead -= 4;
+        return to32bit(p[0], p[1], p[2], p[3]);
+    }
+    c1 = egetc(r);
+    c2 = egetc(r);
+    c3 = egetc(r);
+    c4 = egetc(r);
     return to32bit(c1, c2, c3, c4);
 }
 
 static int
-read16bit(void) {
+read16bit(struct mf_reader *r) {
     int c1, c2;
-    c1 = egetc();
-    c2 = egetc();
+
+    if (r->inbuf && r->bufend - r->bufp >= 2) {
+        const mf_data_t *p = r->bufp;
+
+        r->bufp += 2;
+        r->toberead -= 2;
+        return to16bit(p[0], p[1]);
+    }
+    c1 = egetc(r);
+    c2 = egetc(r);
     return to16bit(c1, c2);
 }
 
 /* The code below allows collection of a system exclusive message of */
-/* arbitrary length.  The Msgbuff is expanded as necessary.  The only */
+/* arbitrary length.  The msgbuff is expanded as necessary.  The only */
 /* visible data/routines are msginit(), msgadd(), msg(), msgleng(). */
 
+/* (msgbuff, msgsize and msgindex in the reader) */
+
 #define MSGINCREMENT 128
-static char *Msgbuff = NULL;  /* message buffer */
-static int Msgsize = 0;       /* Size of currently allocated Msg */
-static int Msgindex = 0;      /* index of next available location in Msg */
 
 static void
-msginit(void) {
-    Msgindex = 0;
+msginit(struct mf_reader *r) {
+    r->msgindex = 0;
 }
 
 static char *
-msg(void) {
-    return(Msgbuff);
+msg(struct mf_reader *r) {
+    return(r->msgbuff);
 }
 
 static int
-msgleng(void) {
-    return(Msgindex);
+msgleng(struct mf_reader *r) {
+    return(r->msgindex);
 }
 
+/* make msgbuff size bytes long */
 static void
-msgadd(int c) {
+msgresize(struct mf_reader *r, int size, char *what) {
+    char *p = realloc(r->msgbuff, size);
+
+    if (!p)
+        mferror(r, what);
+    if (r->stats)
+        r->stats->reallocs++;
+    r->msgbuff = p;
+    r->msgsize = size;
+}
+
+static void
+msgadd(struct mf_reader *r, int c) {
     /* If necessary, allocate larger message buffer. */
-    if (Msgindex >= Msgsize) {
-	Msgsize += MSGINCREMENT;
-	Msgbuff = realloc(Msgbuff, Msgsize);
-	if (!Msgbuff)
-	    mferror("msgadd: realloc failed!");
+    if (r->msgindex >= r->msgsize)
+	msgresize(r, r->msgsize + MSGINCREMENT, "msgadd: realloc failed!");
+    r->msgbuff[r->msgindex++] = c;
+}
+
+/*
+ * Add the next n bytes of input to the message and return the last
+ * byte added (or c if none are).  Reading from memory, the bounds are
+ * checked once and the bytes are copied in one go.
+ */
+static int
+msgaddn(struct mf_reader *r, mf_ssize_t n, int c) {
+    if (n <= 0)
+        return(c);
+    if (!r->inbuf) {
+        while (n-- > 0)
+            msgadd(r, c = egetc(r));
+        return(c);
+    }
+    if (r->bufend - r->bufp < n)
+        premature(r);
+    if (r->msgindex + n > r->msgsize)
+        msgresize(r, r->msgindex + n, "msgaddn: realloc failed!");
+    memcpy(r->msgbuff + r->msgindex, r->bufp, n);
+    r->msgindex += n;
+    r->bufp += n;
+    r->toberead -= n;
+    return r->bufp[-1];
+}
+
+/*
+ * Return the next n bytes of input as a message, setting *lengp to its
+ * length.  Reading from memory no copy is made: the message points
+ * straight into the caller’s buffer.
+ */
+static char *
+msgspan(struct mf_reader *r, mf_ssize_t n, int *lengp) {
+    const mf_data_t *p;
+
+    if (!r->inbuf) {
+        msginit(r);
+        (void) msgaddn(r, n, 0);
+        *lengp = msgleng(r);
+        return(msg(r));
+    }
+    if (n < 0)
+        n = 0;
+    if (r->bufend - r->bufp < n)
+        premature(r);
+    p = r->bufp;
+    r->bufp += n;
+    r->toberead -= n;
+    *lengp = n;
+    return((char *)p);
+}
+
+/* pass the batch of events on to Mf_events */
+static void
+flushevents(struct mf_reader *r) {
+    if (r->nevents > 0)
+        r->Mf_events(r, r->events, r->nevents, r->evdata);
+    r->nevents = 0;
+    r->evdataleng = 0;
+}
+
+/* add an event to the batch, passing the batch on if it is full */
+static void
+addevent(struct mf_reader *r, int status, int c1, int c2,
+        const char *m, int leng) {
+    struct mf_event *ev;
+
+    if (leng < 0)
+        leng = 0;
+    if (r->evdataleng + leng > r->evdatasize) {
+        mf_size_t size = r->evdatasize;
+        char *p;
+
+        do
+            size = size ? 2 * size : 1024;
+        while (r->evdataleng + leng > size);
+        if ((p = realloc(r->evdata, size)) == NULL)
+            mferror(r, "addevent: realloc failed!");
+        if (r->stats)
+            r->stats->reallocs++;
+        r->evdata = p;
+        r->evdatasize = size;
     }
-    Msgbuff[Msgindex++] = c;
+    ev = &r->events[r->nevents++];
+    ev->time = r->currtime;
+    ev->status = status;
+    ev->data1 = c1;
+    ev->data2 = c2;
+    ev->offset = r->evdataleng;
+    ev->leng = leng;
+    if (leng > 0)
+        memcpy(r->evdata + r->evdataleng, m, leng);
+    r->evdataleng += leng;
+    if (r->nevents >= r->maxevents)
+        flushevents(r);
 }
 
 static void
-metaevent(int type) {
-    int leng = msgleng();
-    char *m = msg();
+metaevent(struct mf_reader *r, int type, int leng, char *m) {
+    char pad[5];	/* room for the largest fixed-size event */
+
+    if (r->stats)
+        mf_stats_count(r->stats, 0xff);
+    if (r->batch) {
+        addevent(r, 0xff, type, 0, m, leng);
+        return;
+    }
+
+    /* don’t let a short fixed-size event read past its data */
+    if (leng < (int)sizeof(pad) && (type == 0x00 || type == 0x51 ||
+            type == 0x54 || type == 0x58 || type == 0x59)) {
+        memset(pad, 0, sizeof(pad));
+        if (leng > 0)
+            memcpy(pad, m, leng);
+        m = pad;
+    }
 
     switch (type) {
     case 0x00:
-	if (Mf_seqnum)
-            Mf_seqnum(to16bit(m[0],m[1]));
+	if (r->Mf_seqnum)
+            r->Mf_seqnum(r, to16bit(m[0],m[1]));
 	break;
     case 0x01:      /* Text event */
     case 0x02:      /* Copyright notice */
@@ -207,169 +428,226 @@ metaevent(int type) {
     case 0x0e:
     case 0x0f:
 	/* These are all text events */
-	if (Mf_text)
-	    Mf_text(type,leng,m);
+	if (r->Mf_text)
+	    r->Mf_text(r, type,leng,m);
 	break;
     case 0x2f:      /* End of Track */
-	if (Mf_eot)
-	    Mf_eot();
+	if (r->Mf_eot)
+	    r->Mf_eot(r);
 	break;
     case 0x51:      /* Set tempo */
-	if (Mf_tempo)
-	    Mf_tempo(to32bit(0,m[0],m[1],m[2]));
+	if (r->Mf_tempo)
+	    r->Mf_tempo(r, to32bit(0,m[0],m[1],m[2]));
 	break;
     case 0x54:
-	if (Mf_smpte)
-	    Mf_smpte(m[0],m[1],m[2],m[3],m[4]);
+	if (r->Mf_smpte)
+	    r->Mf_smpte(r, m[0],m[1],m[2],m[3],m[4]);
 	break;
     case 0x58:
-	if (Mf_timesig)
-	    Mf_timesig(m[0],m[1],m[2],m[3]);
+	if (r->Mf_timesig)
+	    r->Mf_timesig(r, m[0],m[1],m[2],m[3]);
 	break;
     case 0x59:
-	if (Mf_keysig)
-	    Mf_keysig(m[0],m[1]);
+	if (r->Mf_keysig)
+	    r->Mf_keysig(r, m[0],m[1]);
 	break;
     case 0x7f:
-	if (Mf_sqspecific)
-	    Mf_sqspecific(leng,m);
+	if (r->Mf_sqspecific)
+	    r->Mf_sqspecific(r, leng,m);
 	break;
     default:
-	if (Mf_metamisc)
-	    Mf_metamisc(type,leng,m);
+	if (r->Mf_metamisc)
+	    r->Mf_metamisc(r, type,leng,m);
     }
 }
 
 static void
-sysex(void) {
-    if (Mf_sysex)
-        Mf_sysex(msgleng(),msg());
+sysex(struct mf_reader *r) {
+    if (r->stats)
+        mf_stats_count(r->stats, 0xf0);
+    if (r->batch)
+        addevent(r, 0xf0, 0, 0, msg(r), msgleng(r));
+    else if (r->Mf_sysex)
+        r->Mf_sysex(r, msgleng(r),msg(r));
 }
 
+/* an 0xf7 event that doesn’t continue a sysex */
 static void
-chanmessage(int status, int c1, int c2) {
+arbitrary(struct mf_reader *r, char *m, int leng) {
+    if (r->stats)
+        mf_stats_count(r->stats, 0xf7);
+    if (r->batch)
+        addevent(r, 0xf7, 0, 0, m, leng);
+    else if (r->Mf_arbitrary)
+        r->Mf_arbitrary(r, leng, m);
+}
+
+static void
+chanmessage(struct mf_reader *r, int status, int c1, int c2) {
     int chan = status & 0xf;
 
+    if (r->stats)
+        mf_stats_count(r->stats, status);
+    if (r->batch) {
+        addevent(r, status, c1, c2, NULL, 0);
+        return;
+    }
     switch (status & 0xf0) {
     case 0x80:
-	if (Mf_off)
-	    Mf_off(chan, c1, c2);
+	if (r->Mf_off)
+	    r->Mf_off(r, chan, c1, c2);
 	break;
     case 0x90:
-	if (Mf_on)
-	    Mf_on(chan, c1, c2);
+	if (r->Mf_on)
+	    r->Mf_on(r, chan, c1, c2);
 	break;
     case 0xa0:
-	if (Mf_pressure)
-	    Mf_pressure(chan, c1, c2);
+	if (r->Mf_pressure)
+	    r->Mf_pressure(r, chan, c1, c2);
 	break;
     case 0xb0:
-	if (Mf_parameter)
-	    Mf_parameter(chan, c1, c2);
+	if (r->Mf_parameter)
+	    r->Mf_parameter(r, chan, c1, c2);
 	break;
     case 0xe0:
-	if (Mf_pitchbend)
-	    Mf_pitchbend(chan, c1, c2);
+	if (r->Mf_pitchbend)
+	    r->Mf_pitchbend(r, chan, c1, c2);
 	break;
     case 0xc0:
-	if (Mf_program)
-	    Mf_program(chan, c1);
+	if (r->Mf_program)
+	    r->Mf_program(r, chan, c1);
 	break;
     case 0xd0:
-	if (Mf_chanpressure)
-	    Mf_chanpressure(chan, c1);
+	if (r->Mf_chanpressure)
+	    r->Mf_chanpressure(r, chan, c1);
 	break;
     }
 }
 
+static void
+expecting(struct mf_reader *r, char *s) {
+    char buff[32];
+
+    (void) strcpy(buff,"expecting ");
+    (void) strcat(buff,s);
+    mferror(r, buff);
+}
+
+/* read through the “MThd” or “MTrk” header string */
 static int
-readmt(char *s) { /* read through the “MThd” or “MTrk” header string */
+readmt(struct mf_reader *r, char *s) {
     int n = 0;
     char *p = s;
-    int c;
+    int c = EOF;
 
-    while (n++ < 4 && (c = Mf_getc()) != EOF) {
-        if (c != *p++) {
-            char buff[32];
-            (void) strcpy(buff,"expecting ");
-            (void) strcat(buff,s);
-            mferror(buff);
-        }
+    while (n++ < 4 && (c = mgetc(r)) != EOF) {
+        if (c != *p++)
+            expecting(r, s);
     }
     return(c);
 }
 
 static void
-readheader(void) {			/* read a header chunk */
+readheader(struct mf_reader *r) {	/* read a header chunk */
     int format, ntrks, division;
 
-    if (readmt("MThd") == EOF)
+    if (readmt(r, "MThd") == EOF)
         return;
 
-    Mf_toberead = read32bit();
-    format = read16bit();
-    ntrks = read16bit();
-    division = read16bit();
+    r->toberead = read32bit(r);
+    format = read16bit(r);
+    ntrks = read16bit(r);
+    division = read16bit(r);
 
-    if (Mf_header)
-        Mf_header(format,ntrks,division);
+    if (r->Mf_header)
+        r->Mf_header(r, format,ntrks,division);
 
     /* flush any extra stuff, in case the length of header is not 6 */
-    while (Mf_toberead > 0)
-        (void) egetc();
+    while (r->toberead > 0)
+        (void) egetc(r);
 }
 
 static mf_varinum_t
-get_lookfor(void) {
+get_lookfor(struct mf_reader *r, int fast) {
 #if 0
     /*
-     * readvarinum has the side effect of updating Mf_toberead.
+     * readvarinum has the side effect of updating r->toberead.
      * stopped working w/ gcc4.
      */
-    return Mf_toberead - readvarinum();
+    return r->toberead - readvarinum(r);
 #else
     /* force order of evaluation: */
-    mf_varinum_t i = readvarinum();
-    return Mf_toberead - i;
+    mf_varinum_t i = fast ? breadvarinum(r) : readvarinum(r);
+    return r->toberead - i;
 #endif
 }
 
+/* This array is indexed by the high half of a status byte.  It’s */
+/* value is either the number of bytes needed (1 or 2) for a channel */
+/* message, or 0 (meaning it’s not  a channel message). */
+static const int chantype[] = {
+    0, 0, 0, 0, 0, 0, 0, 0,    /* 0x00 through 0x70 */
+    2, 2, 2, 2, 1, 1, 2, 0     /* 0x80 through 0xf0 */
+};
+
+/* the track’s length has been read; set up for its events */
+static void
+starttrack(struct mf_reader *r, mf_ssize_t length) {
+    r->toberead = length;
+    r->currtime = 0;
+    r->batch = r->Mf_events && r->events && r->maxevents > 0;
+    r->nevents = 0;
+    r->evdataleng = 0;
+    if (r->stats)
+        r->stats->tracks++;
+
+    if (r->Mf_starttrack)
+        r->Mf_starttrack(r);
+}
+
+static void
+endtrack(struct mf_reader *r) {
+    if (r->batch)
+        flushevents(r);
+    if (r->Mf_endtrack)
+        r->Mf_endtrack(r);
+}
+
 static int
-readtrack(void) {			/* read a track chunk */
-    /* This array is indexed by the high half of a status byte.  It’s */
-    /* value is either the number of bytes needed (1 or 2) for a channel */
-    /* message, or 0 (meaning it’s not  a channel message). */
-    static int chantype[] = {
-        0, 0, 0, 0, 0, 0, 0, 0,    /* 0x00 through 0x70 */
-        2, 2, 2, 2, 1, 1, 2, 0     /* 0x80 through 0xf0 */
-    };
+readtrack(struct mf_reader *r) {	/* read a track chunk */
     mf_varinum_t lookfor;
-    int c, c1 = 0, type;
+    int c, c1 = 0, c2, type, leng;
+    char *m;
     int sysexcontinue = 0; /* 1 if last message was an unfinished sysex */
     int running = 0;       /* 1 when running status used */
     int status = 0;        /* status value (e.g. 0x90==note‐on) */
     int needed;
+    int whole;             /* 1 when the chunk is all in the buffer */
+    int fast;              /* 1 when this event can’t run past it */
 
-    if (readmt("MTrk") == EOF)
+    r->track++;
+    if (readmt(r, "MTrk") == EOF) {
+        r->track--;
         return(0);
+    }
 
-    Mf_toberead = read32bit();
-    Mf_currtime = 0;
-
-    if (Mf_starttrack)
-        Mf_starttrack();
+    starttrack(r, read32bit(r));
+    /* the end of the buffer is checked once for the chunk, not each byte */
+    whole = r->inbuf && r->toberead <= r->bufend - r->bufp;
 
-    while (Mf_toberead > 0) {
-        Mf_currtime += readvarinum();    /* delta time */
+#define GETC(r) (fast ? bgetc(r) : egetc(r))
+    while (r->toberead > 0) {
+        fast = whole && r->toberead >= EVENTHEAD;
+        r->currtime += fast ? breadvarinum(r) : readvarinum(r); /* delta */
 
-        c = egetc();
+        c = GETC(r);
 
         if (sysexcontinue && c != 0xf7)
-            mferror("didn’t find expected continuation of a sysex");
+            mferror(r, "didn’t find expected continuation of a sysex");
 
         if ((c & 0x80) == 0) {   /* running status? */
             if (status == 0)
-                mferror("unexpected running status");
+                mferror(r, "unexpected running status");
             running = 1;
             c1 = c;
             c = status;
@@ -382,72 +660,646 @@ readtrack(void) {			/* read a track chunk */
 
         if (needed) { /* ie. is it a channel message? */
             if (!running)
-                c1 = egetc();
-            chanmessage(status, c1, (needed>1) ? egetc() : 0);
+                c1 = GETC(r);
+            c2 = (needed>1) ? GETC(r) : 0;
+            chanmessage(r, status, c1, c2);
             continue;;
         }
 
         switch (c) {
 	case 0xff:     /* meta event */
-	    type = egetc();
-	    lookfor = get_lookfor();
-	    msginit();
-
-	    while (Mf_toberead > lookfor)
-		msgadd(egetc());
-
-	    metaevent(type);
+	    type = GETC(r);
+	    lookfor = get_lookfor(r, fast);
+	    m = msgspan(r, r->toberead - lookfor, &leng);
+	    metaevent(r, type, leng, m);
 	    break;
 
 	case 0xf0:     /* start of system exclusive */
-	    lookfor = get_lookfor();
-	    msginit();
-	    msgadd(0xf0);
-
-	    while (Mf_toberead > lookfor)
-		msgadd(c = egetc());
+	    lookfor = get_lookfor(r, fast);
+	    msginit(r);
+	    msgadd(r, 0xf0);
+	    c = msgaddn(r, r->toberead - lookfor, c);
 
-	    if (c == 0xf7 || Mf_nomerge == 0)
-		sysex();
+	    if (c == 0xf7 || r->nomerge == 0)
+		sysex(r);
 	    else
 		sysexcontinue = 1;  /* merge into next msg */
 	    break;
 
 	case 0xf7:     /* sysex continuation or arbitrary stuff */
-	    lookfor = get_lookfor();
-	    if (!sysexcontinue)
-		msginit();
-
-	    while (Mf_toberead > lookfor)
-		msgadd(c=egetc());
-
+	    lookfor = get_lookfor(r, fast);
 	    if (!sysexcontinue) {
-		if (Mf_arbitrary)
-		    Mf_arbitrary(msgleng(),msg());
-	    } else if (c == 0xf7) {
-		sysex();
+		m = msgspan(r, r->toberead - lookfor, &leng);
+		arbitrary(r, m, leng);
+		break;
+	    }
+	    c = msgaddn(r, r->toberead - lookfor, c);
+
+	    if (c == 0xf7) {
+		sysex(r);
 		sysexcontinue = 0;
 	    }
 	    break;
 	default:
-	    badbyte(c);
+	    badbyte(r, c);
 	    break;
         }
     }
+#undef GETC
 
-    if (Mf_endtrack)
-        Mf_endtrack();
+    endtrack(r);
     return(1);
 }
 
 MIDIFILE_PUBLIC void
-mfread(void) {
-    if ( Mf_getc == NULL )
-        mferror("mfread() called without setting Mf_getc"); 
+mf_reader_init(struct mf_reader *r) {
+    memset(r, 0, sizeof(*r));
+}
 
-    readheader();
-    while (readtrack())
+/* release the message and payload buffers; the reader may be used again */
+MIDIFILE_PUBLIC void
+mf_reader_free(struct mf_reader *r) {
+    free(r->msgbuff);
+    r->msgbuff = NULL;
+    r->msgsize = r->msgindex = 0;
+    free(r->evdata);
+    r->evdata = NULL;
+    r->evdatasize = r->evdataleng = 0;
+}
+
+/* read a MIDI file a byte at a time through r->Mf_getc() */
+MIDIFILE_PUBLIC int
+mfread_r(struct mf_reader *r) {
+    r->inbuf = 0;
+    r->offset = 0;
+    r->track = 0;
+    CATCH(r, -1);
+    if (r->Mf_getc == NULL)
+        mferror(r, "mfread_r() called without setting Mf_getc");
+
+    readheader(r);
+    while (readtrack(r))
 	;
+    r->catching = 0;
+    if (r->stats)
+        r->stats->bytes += r->offset;
+    return(0);
+}
+
+/*
+ * Read a MIDI file held in memory: as mfread_r(), but the len bytes at
+ * buf are decoded directly rather than one Mf_getc call at a time.
+ * Mf_getc need not be set.  The text, meta, sequencer specific and
+ * arbitrary handlers are passed pointers into buf itself, which must
+ * not be modified through them.
+ */
+MIDIFILE_PUBLIC int
+mfread_buf_r(struct mf_reader *r, const mf_data_t *buf, mf_size_t len) {
+    mf_size_t n, trk;
+
+    n = mfread_header_buf_r(r, buf, len);
+    if (r->err.reason[0])
+        return(-1);
+    while ((trk = mfread_track_buf_r(r, buf + n, len - n)) > 0)
+	n += trk;
+    return(r->err.reason[0] ? -1 : 0);
+}
+
+/*
+ * The pieces of mfread_buf_r(): read the header chunk, or one track
+ * chunk, from the start of the len bytes at buf and return the number
+ * of bytes used.  mfread_track_buf_r() returns 0 when there is no
+ * track left.  Reading a track never looks at the bytes before buf, so
+ * separate readers may decode the tracks of one file at the same time;
+ * set offset and track first for errors to say where they are.  After
+ * an error (with noexit) these return 0.
+ */
+MIDIFILE_PUBLIC mf_size_t
+mfread_header_buf_r(struct mf_reader *r, const mf_data_t *buf,
+	mf_size_t len) {
+    r->offset = 0;
+    r->track = 0;
+    CATCH(r, 0);
+    r->inbuf = 1;
+    r->bufstart = r->bufp = buf;
+    r->bufend = buf + len;
+    readheader(r);
+    r->inbuf = 0;
+    r->catching = 0;
+    r->offset = r->bufp - buf;
+    if (r->stats)
+        r->stats->bytes += r->offset;
+    return(r->bufp - buf);
+}
+
+MIDIFILE_PUBLIC mf_size_t
+mfread_track_buf_r(struct mf_reader *r, const mf_data_t *buf,
+	mf_size_t len) {
+    int more;
+
+    CATCH(r, 0);
+    r->inbuf = 1;
+    r->bufstart = r->bufp = buf;
+    r->bufend = buf + len;
+    more = readtrack(r);
+    r->inbuf = 0;
+    r->catching = 0;
+    r->offset += r->bufp - buf;
+    if (r->stats)
+        r->stats->bytes += r->bufp - buf;
+    return(more ? (mf_size_t)(r->bufp - buf) : 0);
+}
+
+/*
+ * Push reading.  mfread_feed_r() takes the file in pieces of any size,
+ * as they arrive, and mfread_finish_r() says it has ended.  This is
+ * readheader() and readtrack() turned inside out: where they would
+ * wait for a byte, the state is kept in the reader (pstate says what
+ * the next byte is) and mfread_feed_r() returns.  Only meta and sysex
+ * events that are split between pieces are collected in msgbuff;
+ * everything else is decoded straight from the caller’s buffer.
+ */
+
+enum {
+    PS_TAG,			/* the “MThd” or “MTrk” of a chunk */
+    PS_LENGTH,			/* the chunk length */
+    PS_HEADER,			/* format, ntrks and division */
+    PS_SKIP,			/* the rest of the header chunk */
+    PS_DELTA,			/* an event’s delta time */
+    PS_STATUS,			/* its status byte */
+    PS_DATA,			/* the data bytes of a channel message */
+    PS_METATYPE,		/* the type of a meta event */
+    PS_EVLENGTH,		/* the length of a meta or sysex event */
+    PS_BODY,			/* its bytes */
+    PS_FAILED			/* an error; wait for mfread_finish_r() */
+};
+
+/* an event has been dealt with: on to the next, or the next chunk */
+static void
+pushnext(struct mf_reader *r) {
+    r->pval = 0;
+    if (r->toberead > 0) {
+        r->pstate = PS_DELTA;
+        return;
+    }
+    endtrack(r);
+    r->pgot = 0;
+    r->pstate = PS_TAG;
+}
+
+/* the last of a meta or sysex event, leng bytes at m, is in */
+static void
+pushevent(struct mf_reader *r, char *m, int leng) {
+    int c = leng > 0 ? (mf_data_t)m[leng - 1] : r->pc;
+
+    switch (r->pc) {
+    case 0xff:
+        metaevent(r, r->ptype, leng, m);
+        break;
+
+    case 0xf0:
+        if (c == 0xf7 || r->nomerge == 0)
+            sysex(r);
+        else
+            r->psysex = 1;  /* merge into next msg */
+        break;
+
+    case 0xf7:
+        if (!r->psysex)
+            arbitrary(r, m, leng);
+        else if (c == 0xf7) {
+            sysex(r);
+            r->psysex = 0;
+        }
+        break;
+    }
+    pushnext(r);
+}
+
+/* take in as much of the body of a meta or sysex event as is here */
+static void
+pushbody(struct mf_reader *r) {
+    mf_ssize_t n = r->bufend - r->bufp;
+    const mf_data_t *p = r->bufp;
+
+    if (n > r->pleft)
+        n = r->pleft;
+    r->bufp += n;
+    r->toberead -= n;
+    r->pleft -= n;
+
+    /* all here at once, and not part of a sysex: use it where it is */
+    if (r->pleft == 0 && r->msgindex == 0 && r->pc != 0xf0 && !r->psysex) {
+        pushevent(r, (char *)p, n);
+        return;
+    }
+    if (r->msgindex + n > r->msgsize)
+        msgresize(r, r->msgindex + n + MSGINCREMENT,
+                "mfread_feed_r: realloc failed!");
+    memcpy(r->msgbuff + r->msgindex, p, n);
+    r->msgindex += n;
+    if (r->pleft == 0) {
+        /* the sysex collected so far is passed on, so only this part */
+        if (r->pc == 0xf0 || r->psysex)
+            pushevent(r, msg(r) + msgleng(r) - n, n);
+        else
+            pushevent(r, msg(r), msgleng(r));
+    }
+}
+
+/* decode the bytes from r->bufp to r->bufend */
+static void
+push(struct mf_reader *r) {
+    int c, needed;
+
+    while (r->bufp < r->bufend) {
+        if (r->pstate == PS_BODY) {
+            pushbody(r);
+            continue;
+        }
+        c = *r->bufp++;
+        if (r->pstate > PS_LENGTH)
+            r->toberead--;
+
+        switch (r->pstate) {
+        case PS_TAG:
+            if (r->pgot == 0 && r->pchunks > 0)
+                r->track++;
+            if (c != (r->pchunks ? "MTrk" : "MThd")[r->pgot])
+                expecting(r, r->pchunks ? "MTrk" : "MThd");
+            if (++r->pgot == 4) {
+                r->pgot = 0;
+                r->pval = 0;
+                r->pstate = PS_LENGTH;
+            }
+            break;
+
+        case PS_LENGTH:
+            r->pval = (r->pval << 8) | c;
+            if (++r->pgot < 4)
+                break;
+            r->pgot = 0;
+            if (r->pchunks++ == 0) {
+                r->toberead = (int32_t)r->pval;
+                r->pstate = PS_HEADER;
+                break;
+            }
+            starttrack(r, (int32_t)r->pval);
+            r->pstatus = 0;
+            r->psysex = 0;
+            pushnext(r);
+            break;
+
+        case PS_HEADER:
+            r->pbytes[r->pgot++] = c;
+            if (r->pgot < 6)
+                break;
+            r->pgot = 0;
+            if (r->Mf_header)
+                r->Mf_header(r, to16bit(r->pbytes[0], r->pbytes[1]),
+                        to16bit(r->pbytes[2], r->pbytes[3]),
+                        to16bit(r->pbytes[4], r->pbytes[5]));
+            r->pstate = r->toberead > 0 ? PS_SKIP : PS_TAG;
+            break;
+
+        case PS_SKIP:
+            if (r->toberead <= 0)
+                r->pstate = PS_TAG;
+            break;
+
+        case PS_DELTA:
+            r->pval = (r->pval << 7) | (c & 0x7f);
+            if (c & 0x80)
+                break;
+            r->currtime += (mf_varinum_t)r->pval;
+            r->pstate = PS_STATUS;
+            break;
+
+        case PS_STATUS:
+            if (r->psysex && c != 0xf7)
+                mferror(r, "didn’t find expected continuation of a sysex");
+
+            r->pgot = 0;
+            if ((c & 0x80) == 0) {   /* running status? */
+                if (r->pstatus == 0)
+                    mferror(r, "unexpected running status");
+                r->pbytes[r->pgot++] = c;
+                c = r->pstatus;
+            } else if (c < 0xf0)
+                r->pstatus = c;
+
+            if ((needed = chantype[(c>>4) & 0xf]) != 0) {
+                r->pneed = needed;
+                r->pstate = PS_DATA;
+                if (r->pgot < needed)
+                    break;
+                r->pbytes[1] = 0;
+                goto channel;
+            }
+
+            r->pc = c;
+            r->pval = 0;
+            switch (c) {
+            case 0xff:
+                r->pstate = PS_METATYPE;
+                break;
+            case 0xf0:
+            case 0xf7:
+                r->pstate = PS_EVLENGTH;
+                break;
+            default:
+                badbyte(r, c);
+            }
+            break;
+
+        case PS_DATA:
+            r->pbytes[r->pgot++] = c;
+            if (r->pgot < r->pneed)
+                break;
+            if (r->pneed < 2)
+                r->pbytes[1] = 0;
+channel:
+            chanmessage(r, r->pstatus, r->pbytes[0], r->pbytes[1]);
+            pushnext(r);
+            break;
+
+        case PS_METATYPE:
+            r->ptype = c;
+            r->pstate = PS_EVLENGTH;
+            break;
+
+        case PS_EVLENGTH:
+            r->pval = (r->pval << 7) | (c & 0x7f);
+            if (c & 0x80)
+                break;
+            r->pleft = (int32_t)r->pval;
+            if (r->pleft < 0)
+                r->pleft = 0;
+            if (r->pc == 0xf0) {
+                msginit(r);
+                msgadd(r, 0xf0);
+            } else if (!r->psysex)
+                msginit(r);
+            r->pstate = PS_BODY;
+            if (r->pleft == 0)
+                pushbody(r);
+            break;
+        }
+    }
+}
+
+/*
+ * Decode the next len bytes of a MIDI file, calling the handlers as
+ * mfread_r() would.  Returns 0, or -1 after an error (with noexit),
+ * after which the rest of the file is ignored.
+ */
+MIDIFILE_PUBLIC int
+mfread_feed_r(struct mf_reader *r, const mf_data_t *buf, mf_size_t len) {
+    if (r->pstate == PS_FAILED)
+        return(-1);
+    if (r->pstate == PS_TAG && r->pchunks == 0 && r->pgot == 0)
+        r->offset = r->track = 0;	/* a new file */
+    memset(&r->err, 0, sizeof(r->err));
+    if (r->noexit) {
+        if (setjmp(r->jump)) {
+            r->pstate = PS_FAILED;
+            return(-1);
+        }
+        r->catching = 1;
+    }
+    r->inbuf = 1;
+    r->bufstart = r->bufp = buf;
+    r->bufend = buf + len;
+    push(r);
+    r->inbuf = 0;
+    r->catching = 0;
+    r->offset += len;
+    if (r->stats)
+        r->stats->bytes += len;
+    return(0);
+}
+
+/*
+ * As mfread_feed_r(), for track chunks without the header before them:
+ * a track fed a piece at a time, say, to decode several side by side.
+ * Set offset and track first, as for mfread_track_buf_r().
+ */
+MIDIFILE_PUBLIC int
+mfread_feed_tracks_r(struct mf_reader *r, const mf_data_t *buf,
+	mf_size_t len) {
+    if (r->pstate == PS_TAG && r->pchunks == 0 && r->pgot == 0)
+        r->pchunks = 1;		/* as if the header had been read */
+    return(mfread_feed_r(r, buf, len));
+}
+
+/*
+ * The file has ended.  Returns 0, or -1 if it ended in the middle of a
+ * chunk or there was an error before.  The reader is then ready for
+ * the next file.
+ */
+MIDIFILE_PUBLIC int
+mfread_finish_r(struct mf_reader *r) {
+    int state = r->pstate;
+
+    r->pstate = PS_TAG;
+    r->pchunks = r->pgot = 0;
+    if (state == PS_FAILED)
+        return(-1);
+    if (state == PS_TAG)
+        return(0);
+    CATCH(r, -1);
+    mferror(r, "premature EOF");
+    return(-1);
+}
+
+/*
+ * Compatibility: handlers for Mf_reader that pass each event on to the
+ * corresponding Mf_* function, keeping Mf_currtime up to date.
+ */
+
+static int
+compat_getc(struct mf_reader *r) {
+    int c = Mf_getc();
+
+    (void) r;
+    return feof(stdin) ? EOF : c;
+}
+
+static void
+compat_header(struct mf_reader *r, int format, int ntrks, int division) {
+    Mf_currtime = r->currtime;
+    Mf_header(format, ntrks, division);
+}
+
+static void
+compat_starttrack(struct mf_reader *r) {
+    Mf_currtime = r->currtime;
+    Mf_starttrack();
+}
+
+static void
+compat_endtrack(struct mf_reader *r) {
+    Mf_currtime = r->currtime;
+    Mf_endtrack();
+}
+
+static void
+compat_on(struct mf_reader *r, int chan, int pitch, int vol) {
+    Mf_currtime = r->currtime;
+    Mf_on(chan, pitch, vol);
+}
+
+static void
+compat_off(struct mf_reader *r, int chan, int pitch, int vol) {
+    Mf_currtime = r->currtime;
+    Mf_off(chan, pitch, vol);
+}
+
+static void
+compat_pressure(struct mf_reader *r, int chan, int pitch, int press) {
+    Mf_currtime = r->currtime;
+    Mf_pressure(chan, pitch, press);
+}
+
+static void
+compat_parameter(struct mf_reader *r, int chan, int control, int value) {
+    Mf_currtime = r->currtime;
+    Mf_parameter(chan, control, value);
+}
+
+static void
+compat_pitchbend(struct mf_reader *r, int chan, int lsb, int msb) {
+    Mf_currtime = r->currtime;
+    Mf_pitchbend(chan, lsb, msb);
+}
+
+static void
+compat_program(struct mf_reader *r, int chan, int program) {
+    Mf_currtime = r->currtime;
+    Mf_program(chan, program);
+}
+
+static void
+compat_chanpressure(struct mf_reader *r, int chan, int press) {
+    Mf_currtime = r->currtime;
+    Mf_chanpressure(chan, press);
+}
+
+static void
+compat_sysex(struct mf_reader *r, int leng, char *mess) {
+    Mf_currtime = r->currtime;
+    Mf_sysex(leng, mess);
+}
+
+static void
+compat_metamisc(struct mf_reader *r, int type, int leng, char *mess) {
+    Mf_currtime = r->currtime;
+    Mf_metamisc(type, leng, mess);
+}
+
+static void
+compat_sqspecific(struct mf_reader *r, int leng, char *mess) {
+    Mf_currtime = r->currtime;
+    Mf_sqspecific(leng, mess);
+}
+
+static void
+compat_seqnum(struct mf_reader *r, int num) {
+    Mf_currtime = r->currtime;
+    Mf_seqnum(num);
+}
+
+static void
+compat_text(struct mf_reader *r, int type, int leng, char *mess) {
+    Mf_currtime = r->currtime;
+    Mf_text(type, leng, mess);
+}
+
+static void
+compat_eot(struct mf_reader *r) {
+    Mf_currtime = r->currtime;
+    Mf_eot();
+}
+
+static void
+compat_timesig(struct mf_reader *r, int nn, int dd, int cc, int bb) {
+    Mf_currtime = r->currtime;
+    Mf_timesig(nn, dd, cc, bb);
+}
+
+static void
+compat_smpte(struct mf_reader *r, int hr, int mn, int se, int fr, int ff) {
+    Mf_currtime = r->currtime;
+    Mf_smpte(hr, mn, se, fr, ff);
+}
+
+static void
+compat_tempo(struct mf_reader *r, mf_tempo_t tempo) {
+    Mf_currtime = r->currtime;
+    Mf_tempo(tempo);
+}
+
+static void
+compat_keysig(struct mf_reader *r, int sf, int mi) {
+    Mf_currtime = r->currtime;
+    Mf_keysig(sf, mi);
+}
+
+static void
+compat_arbitrary(struct mf_reader *r, int leng, char *mess) {
+    Mf_currtime = r->currtime;
+    Mf_arbitrary(leng, mess);
+}
+
+static void
+compat_rerror(struct mf_reader *r, char *s) {
+    Mf_currtime = r->currtime;
+    Mf_rerror(s);
+}
+
+/* point Mf_reader at the compat_* handler for each Mf_* that is set */
+static struct mf_reader *
+compat_reader(void) {
+    struct mf_reader *r = &Mf_reader;
+
+#define COMPAT(NAME) r->Mf_##NAME = Mf_##NAME ? compat_##NAME : NULL
+    COMPAT(getc);
+    COMPAT(header);
+    COMPAT(starttrack);
+    COMPAT(endtrack);
+    COMPAT(on);
+    COMPAT(off);
+    COMPAT(pressure);
+    COMPAT(parameter);
+    COMPAT(pitchbend);
+    COMPAT(program);
+    COMPAT(chanpressure);
+    COMPAT(sysex);
+    COMPAT(metamisc);
+    COMPAT(sqspecific);
+    COMPAT(seqnum);
+    COMPAT(text);
+    COMPAT(eot);
+    COMPAT(timesig);
+    COMPAT(smpte);
+    COMPAT(tempo);
+    COMPAT(keysig);
+    COMPAT(arbitrary);
+    COMPAT(rerror);
+#undef COMPAT
+    r->nomerge = Mf_nomerge;
+    return(r);
+}
+
+MIDIFILE_PUBLIC void
+mfread(void) {
+    mfread_r(compat_reader());
+}
+
+/* as mfread_buf_r(), for the Mf_* handlers */
+MIDIFILE_PUBLIC void
+mfread_buf(const mf_data_t *buf, mf_size_t len) {
+    mfread_buf_r(compat_reader(), buf, len);
 }
 
 /* for backward compatibility with the original lib */
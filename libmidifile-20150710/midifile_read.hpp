@@ -0,0 +1,373 @@
+/*
+ * midifile_read.hpp
+ *
+ * Read a MIDI file held in memory, C++ style.  This is the decoder of
+ * midifile_read.c as a template on the class that handles the events,
+ * so that the handlers are called directly (and usually inlined) rather
+ * than through the Mf_* pointers, and those not wanted cost nothing:
+ *
+ *	struct counter : mf::reader<counter> {
+ *	    long notes;
+ *	    counter() : notes(0) {}
+ *	    void on(int chan, int pitch, int vol) { notes++; }
+ *	};
+ *
+ *	counter c;
+ *	c.read(buf, len);
+ *
+ * The handlers have the names and arguments of the Mf_* functions
+ * without the prefix (on, off, text, tempo, ...), and those not
+ * defined default to doing nothing.  currtime() is the time of the
+ * event being handled and nomerge is as Mf_nomerge.  Running status,
+ * sysex continuation and the error messages are as in midifile_read.c;
+ * after error() the program exits.
+ */
+
+#ifndef MIDIFILE_READ_HPP
+#define MIDIFILE_READ_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "midifile.h"
+
+namespace mf {
+
+template <class Handler>
+class reader {
+public:
+    int nomerge;		/* 1 => continued sysex are not collapsed */
+
+    reader() : nomerge(0), currtime_(0), toberead(0), bufp(0), bufend(0) {}
+
+    mf_deltat_t currtime() const { return currtime_; }
+
+    /* read the len bytes of MIDI file at buf */
+    void read(const mf_data_t *buf, mf_size_t len) {
+	bufp = buf;
+	bufend = buf + len;
+	readheader();
+	while (readtrack())
+	    ;
+    }
+
+    /* the handlers; define any of these in Handler */
+    void header(int, int, int) {}
+    void starttrack() {}
+    void endtrack() {}
+    void on(int, int, int) {}
+    void off(int, int, int) {}
+    void pressure(int, int, int) {}
+    void parameter(int, int, int) {}
+    void pitchbend(int, int, int) {}
+    void program(int, int) {}
+    void chanpressure(int, int) {}
+    void sysex(int, char *) {}
+    void metamisc(int, int, char *) {}
+    void sqspecific(int, char *) {}
+    void seqnum(int) {}
+    void text(int, int, char *) {}
+    void eot() {}
+    void timesig(int, int, int, int) {}
+    void smpte(int, int, int, int, int) {}
+    void tempo(mf_tempo_t) {}
+    void keysig(int, int) {}
+    void arbitrary(int, char *) {}
+    void error(char *) {}
+
+private:
+    mf_deltat_t currtime_;
+    mf_ssize_t toberead;	/* bytes left in the current chunk */
+    const mf_data_t *bufp;	/* next byte to read */
+    const mf_data_t *bufend;	/* end of buffer */
+    std::vector<char> msgbuff;	/* sysex being collected */
+
+    Handler &h() { return *static_cast<Handler *>(this); }
+
+    void mferror(const char *s) {
+	h().error(const_cast<char *>(s));
+	std::exit(1);
+    }
+
+    void badbyte(int c) {
+	char buff[32];
+
+	std::sprintf(buff, "unexpected byte: %#02x", c);
+	mferror(buff);
+    }
+
+    int mgetc() {
+	return (bufp < bufend) ? *bufp++ : EOF;
+    }
+
+    int egetc() {
+	if (bufp >= bufend)
+	    mferror("premature EOF");
+	toberead--;
+	return *bufp++;
+    }
+
+    mf_varinum_t readvarinum() {
+	uint32_t value;
+	int c;
+
+	value = c = egetc();
+	if (c & 0x80) {
+	    value &= 0x7f;
+	    do {
+		c = egetc();
+		value = (value << 7) + (c & 0x7f);
+	    } while (c & 0x80);
+	}
+	return (mf_varinum_t)value;
+    }
+
+    static int32_t to32bit(int c1, int c2, int c3, int c4) {
+	return (int32_t)(((uint32_t)(c1 & 0xff) << 24) | ((c2 & 0xff) << 16) |
+		((c3 & 0xff) << 8) | (c4 & 0xff));
+    }
+
+    static int to16bit(int c1, int c2) {
+	return ((c1 & 0xff) << 8) + (c2 & 0xff);
+    }
+
+    int32_t read32bit() {
+	int c1 = egetc(), c2 = egetc(), c3 = egetc(), c4 = egetc();
+	return to32bit(c1, c2, c3, c4);
+    }
+
+    int read16bit() {
+	int c1 = egetc(), c2 = egetc();
+	return to16bit(c1, c2);
+    }
+
+    /* the next n bytes of input, which stay where they are */
+    char *msgspan(mf_ssize_t n, int *lengp) {
+	const mf_data_t *p = bufp;
+
+	if (n < 0)
+	    n = 0;
+	if (bufend - bufp < n)
+	    mferror("premature EOF");
+	bufp += n;
+	toberead -= n;
+	*lengp = n;
+	return (char *)p;
+    }
+
+    /* add the next n bytes to msgbuff; the last one added, or c */
+    int msgaddn(mf_ssize_t n, int c) {
+	const char *p = reinterpret_cast<const char *>(bufp);
+
+	if (n <= 0)
+	    return c;
+	if (bufend - bufp < n)
+	    mferror("premature EOF");
+	msgbuff.insert(msgbuff.end(), p, p + n);
+	bufp += n;
+	toberead -= n;
+	return bufp[-1];
+    }
+
+    void sysex() {
+	h().sysex((int)msgbuff.size(), &msgbuff[0]);
+    }
+
+    void metaevent(int type, int leng, char *m) {
+	char pad[5];	/* room for the largest fixed-size event */
+
+	if (leng < (int)sizeof(pad) && (type == 0x00 || type == 0x51 ||
+		type == 0x54 || type == 0x58 || type == 0x59)) {
+	    std::memset(pad, 0, sizeof(pad));
+	    if (leng > 0)
+		std::memcpy(pad, m, leng);
+	    m = pad;
+	}
+
+	switch (type) {
+	case 0x00:
+	    h().seqnum(to16bit(m[0], m[1]));
+	    break;
+	case 0x01: case 0x02: case 0x03: case 0x04:
+	case 0x05: case 0x06: case 0x07: case 0x08:
+	case 0x09: case 0x0a: case 0x0b: case 0x0c:
+	case 0x0d: case 0x0e: case 0x0f:
+	    /* These are all text events */
+	    h().text(type, leng, m);
+	    break;
+	case 0x2f:      /* End of Track */
+	    h().eot();
+	    break;
+	case 0x51:      /* Set tempo */
+	    h().tempo(to32bit(0, m[0], m[1], m[2]));
+	    break;
+	case 0x54:
+	    h().smpte(m[0], m[1], m[2], m[3], m[4]);
+	    break;
+	case 0x58:
+	    h().timesig(m[0], m[1], m[2], m[3]);
+	    break;
+	case 0x59:
+	    h().keysig(m[0], m[1]);
+	    break;
+	case 0x7f:
+	    h().sqspecific(leng, m);
+	    break;
+	default:
+	    h().metamisc(type, leng, m);
+	}
+    }
+
+    void chanmessage(int status, int c1, int c2) {
+	int chan = status & 0xf;
+
+	switch (status & 0xf0) {
+	case 0x80: h().off(chan, c1, c2); break;
+	case 0x90: h().on(chan, c1, c2); break;
+	case 0xa0: h().pressure(chan, c1, c2); break;
+	case 0xb0: h().parameter(chan, c1, c2); break;
+	case 0xe0: h().pitchbend(chan, c1, c2); break;
+	case 0xc0: h().program(chan, c1); break;
+	case 0xd0: h().chanpressure(chan, c1); break;
+	}
+    }
+
+    /* read through the “MThd” or “MTrk” header string */
+    int readmt(const char *s) {
+	int n = 0;
+	const char *p = s;
+	int c = EOF;
+
+	while (n++ < 4 && (c = mgetc()) != EOF) {
+	    if (c != *p++) {
+		char buff[32];
+		std::strcpy(buff, "expecting ");
+		std::strcat(buff, s);
+		mferror(buff);
+	    }
+	}
+	return c;
+    }
+
+    void readheader() {
+	int format, ntrks, division;
+
+	if (readmt("MThd") == EOF)
+	    return;
+
+	toberead = read32bit();
+	format = read16bit();
+	ntrks = read16bit();
+	division = read16bit();
+
+	h().header(format, ntrks, division);
+
+	/* flush any extra stuff, in case the length of header is not 6 */
+	while (toberead > 0)
+	    (void) egetc();
+    }
+
+    mf_varinum_t get_lookfor() {
+	mf_varinum_t i = readvarinum();
+	return toberead - i;
+    }
+
+    bool readtrack() {
+	static const int chantype[] = {
+	    0, 0, 0, 0, 0, 0, 0, 0,    /* 0x00 through 0x70 */
+	    2, 2, 2, 2, 1, 1, 2, 0     /* 0x80 through 0xf0 */
+	};
+	mf_varinum_t lookfor;
+	int c, c1 = 0, type, leng;
+	char *m;
+	int sysexcontinue = 0; /* 1 if last message was an unfinished sysex */
+	int running = 0;       /* 1 when running status used */
+	int status = 0;        /* status value (e.g. 0x90==note‐on) */
+	int needed;
+
+	if (readmt("MTrk") == EOF)
+	    return false;
+
+	toberead = read32bit();
+	currtime_ = 0;
+
+	h().starttrack();
+
+	while (toberead > 0) {
+	    currtime_ += readvarinum();    /* delta time */
+
+	    c = egetc();
+
+	    if (sysexcontinue && c != 0xf7)
+		mferror("didn’t find expected continuation of a sysex");
+
+	    if ((c & 0x80) == 0) {   /* running status? */
+		if (status == 0)
+		    mferror("unexpected running status");
+		running = 1;
+		c1 = c;
+		c = status;
+	    } else if (c < 0xf0) {
+		status = c;
+		running = 0;
+	    }
+
+	    needed = chantype[(c >> 4) & 0xf];
+
+	    if (needed) { /* ie. is it a channel message? */
+		if (!running)
+		    c1 = egetc();
+		chanmessage(status, c1, (needed > 1) ? egetc() : 0);
+		continue;
+	    }
+
+	    switch (c) {
+	    case 0xff:     /* meta event */
+		type = egetc();
+		lookfor = get_lookfor();
+		m = msgspan(toberead - lookfor, &leng);
+		metaevent(type, leng, m);
+		break;
+
+	    case 0xf0:     /* start of system exclusive */
+		lookfor = get_lookfor();
+		msgbuff.clear();
+		msgbuff.push_back((char)0xf0);
+		c = msgaddn(toberead - lookfor, c);
+
+		if (c == 0xf7 || nomerge == 0)
+		    sysex();
+		else
+		    sysexcontinue = 1;  /* merge into next msg */
+		break;
+
+	    case 0xf7:     /* sysex continuation or arbitrary stuff */
+		lookfor = get_lookfor();
+		if (!sysexcontinue) {
+		    m = msgspan(toberead - lookfor, &leng);
+		    h().arbitrary(leng, m);
+		    break;
+		}
+		c = msgaddn(toberead - lookfor, c);
+
+		if (c == 0xf7) {
+		    sysex();
+		    sysexcontinue = 0;
+		}
+		break;
+	    default:
+		badbyte(c);
+		break;
+	    }
+	}
+
+	h().endtrack();
+	return true;
+    }
+};
+
+} /* namespace mf */
+
+#endif /* MIDIFILE_READ_HPP */
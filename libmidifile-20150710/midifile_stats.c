@@ -0,0 +1,67 @@
+/*
+ * Statistics kept by readers and writers that have stats set (see
+ * midifile.h), and a way to write them out.
+ */
+
+#include <stdio.h>
+
+#include "midifile.h"
+
+/* count an event: a channel message, 0xff meta, 0xf0 sysex or 0xf7 */
+MIDIFILE_PUBLIC void
+mf_stats_count(struct mf_stats *s, int status) {
+    s->events++;
+    if (status < 0xf0)
+        s->chan[(status >> 4) & 7][status & 0xf]++;
+    else if (status == 0xff)
+        s->meta++;
+    else if (status == 0xf0)
+        s->sysex++;
+    else
+        s->arbitrary++;
+}
+
+MIDIFILE_PUBLIC void
+mf_stats_add(struct mf_stats *to, const struct mf_stats *from) {
+    int i, j;
+
+    to->events += from->events;
+    for (i = 0; i < 7; i++)
+        for (j = 0; j < 16; j++)
+            to->chan[i][j] += from->chan[i][j];
+    to->meta += from->meta;
+    to->sysex += from->sysex;
+    to->arbitrary += from->arbitrary;
+    to->tracks += from->tracks;
+    to->bytes += from->bytes;
+    to->reallocs += from->reallocs;
+}
+
+/*
+ * Write the event counts that aren’t 0 to fp, a line each of the form
+ * “<prefix>event=on ch=1 count=12” (channels from 1, as mf2t has them),
+ * for a program to read.
+ */
+MIDIFILE_PUBLIC void
+mf_stats_print(FILE *fp, const char *prefix, const struct mf_stats *s) {
+    static const char *names[7] = {
+        "off", "on", "pressure", "parameter", "program", "chanpressure",
+        "pitchbend"
+    };
+    int i, j;
+
+    for (i = 0; i < 7; i++)
+        for (j = 0; j < 16; j++)
+            if (s->chan[i][j])
+                fprintf(fp, "%sevent=%s ch=%d count=%llu\n", prefix,
+                        names[i], j + 1, (unsigned long long)s->chan[i][j]);
+    if (s->meta)
+        fprintf(fp, "%sevent=meta count=%llu\n", prefix,
+                (unsigned long long)s->meta);
+    if (s->sysex)
+        fprintf(fp, "%sevent=sysex count=%llu\n", prefix,
+                (unsigned long long)s->sysex);
+    if (s->arbitrary)
+        fprintf(fp, "%sevent=arbitrary count=%llu\n", prefix,
+                (unsigned long long)s->arbitrary);
+}
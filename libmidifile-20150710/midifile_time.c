@@ -1,34 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>			/* realloc */
+#include <string.h>
+
 #include "midifile.h"
 
 /* $Id: midifile.c,v 1.4 1991/11/17 21:57:26 piet Rel piet $ */
 /*
  * midifile 1.11
- * 
+ *
  * Utilities to read and write a MIDI file.
  */
 
-/* 
- * This routine converts delta times in ticks into seconds. The
- * else statement is needed because the formula is different for tracks
- * based on notes and tracks based on SMPTE times.
- *
+/*
+ * The units of time to a µs (*scale) and per tick (*step) for division
+ * and tempo; 0 if division is no good.  With bit 15 set the upper byte
+ * is minus the frames per second, 29 being 30 drop frame, 29.97.
+ */
+static int
+rate(int division, mf_tempo_t tempo, uint64_t *scale, uint64_t *step) {
+    int frames = -(signed char)upperbyte(division);
+
+    if ((division & 0x8000) == 0) {
+        *scale = division;
+        *step = tempo;
+    } else if (frames == 29) {
+        *scale = 30000 * lowerbyte(division);
+        *step = 1000000 * (uint64_t)1001;
+    } else {
+        *scale = frames * lowerbyte(division);
+        *step = 1000000;
+    }
+    return(*scale != 0);
+}
+
+/*
+ * This routine converts delta times in ticks into seconds, at one
+ * tempo.  For SMPTE division tempo doesn’t count.
  */
 MIDIFILE_PUBLIC float
 mf_ticks2sec(mf_ticks_t ticks, int division, mf_tempo_t tempo) {
-    float smpte_format, smpte_resolution;
+    uint64_t scale, step;
+
+    if (!rate(division, tempo, &scale, &step))
+        return(0);
+    return((float)((double)ticks * step / scale / 1000000.0));
+} /* end of ticks2sec() */
+
+MIDIFILE_PUBLIC mf_ticks_t
+mf_sec2ticks(float secs, int division, unsigned int tempo) {
+    uint64_t scale, step;
+
+    if (!rate(division, tempo, &scale, &step) || step == 0)
+        return(0);
+    return((mf_ticks_t)(secs * 1000000.0 * scale / step));
+}
+
+MIDIFILE_PUBLIC int
+mf_tempo_map_init(struct mf_tempo_map *m, int division) {
+    m->division = division;
+    m->nsegs = m->maxsegs = 0;
+    m->segs = NULL;
+    if (!rate(division, 500000, &m->scale, &m->step))
+        return(-1);
+    if ((division & 0x8000) == 0)
+        m->step = 0;
+    if ((m->segs = malloc(16 * sizeof(*m->segs))) == NULL)
+        return(-1);
+    m->maxsegs = 16;
+    m->nsegs = 1;
+    m->segs[0].tick = 0;
+    m->segs[0].tempo = 500000;
+    m->segs[0].time = 0;
+    return(0);
+}
+
+MIDIFILE_PUBLIC void
+mf_tempo_map_free(struct mf_tempo_map *m) {
+    free(m->segs);
+    m->segs = NULL;
+    m->nsegs = m->maxsegs = 0;
+}
+
+/* the last segment at or before tick */
+static int
+findtick(const struct mf_tempo_map *m, mf_ticks_t tick) {
+    int lo = 0, hi = m->nsegs - 1, mid;
+
+    if (m->segs[hi].tick <= tick)	/* the usual case, adding */
+        return(hi);
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (m->segs[mid].tick <= tick)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return(lo);
+}
+
+/*
+ * A Tempo at tick.  They may come in any order, from any track, but
+ * one out of order moves the segments after it; one at the tick of
+ * another replaces it.  -1 if out of memory.
+ */
+MIDIFILE_PUBLIC int
+mf_tempo_map_add(struct mf_tempo_map *m, mf_ticks_t tick, mf_tempo_t tempo) {
+    struct mf_tempo_seg *s, *more;
+    int i = findtick(m, tick), j;
 
-    if (division > 0)
-        return ((float) (((float)(ticks) * (float)(tempo)) /
-                ((float)(division) * 1000000.0)));
+    if (m->step)			/* SMPTE */
+        return(0);
+    if (m->segs[i].tick == tick)
+        m->segs[i].tempo = tempo;
     else {
-        smpte_format = upperbyte(division);
-        smpte_resolution = lowerbyte(division);
-        return (float) ((float) ticks / (smpte_format * smpte_resolution *
-                1000000.0));
+        if (m->nsegs == m->maxsegs) {
+            more = realloc(m->segs, 2 * m->maxsegs * sizeof(*more));
+            if (more == NULL)
+                return(-1);
+            m->segs = more;
+            m->maxsegs *= 2;
+        }
+        s = &m->segs[++i];
+        memmove(s + 1, s, (m->nsegs++ - i) * sizeof(*s));
+        s->tick = tick;
+        s->tempo = tempo;
     }
-} /* end of ticks2sec() */
+    for (j = i ? i : 1; j < m->nsegs; j++) {
+        s = &m->segs[j];
+        s->time = s[-1].time + (uint64_t)(s->tick - s[-1].tick) * s[-1].tempo;
+    }
+    return(0);
+}
+
+/* the time at tick, which is in segment i */
+static uint64_t
+timeat(const struct mf_tempo_map *m, int i, mf_ticks_t tick, uint64_t *rem) {
+    const struct mf_tempo_seg *s = &m->segs[i];
+    uint64_t t = s->time + (tick - s->tick) * (m->step ? m->step : s->tempo);
+
+    if (rem)
+        *rem = t % m->scale;
+    return(t / m->scale);
+}
 
+/*
+ * The time at tick, in µs rounded down; if rem isn’t NULL, what was
+ * left over goes in *rem, in 1/scale µs.
+ */
+MIDIFILE_PUBLIC uint64_t
+mf_tempo_map_us(const struct mf_tempo_map *m, mf_ticks_t tick, uint64_t *rem) {
+    return(timeat(m, findtick(m, tick), tick, rem));
+}
+
+/*
+ * As mf_tempo_map_us(), for ticks that don’t go down, as in a track:
+ * *seg is the segment the last one was in (0 for the first), so it is
+ * found by stepping on from there.  Tempos added at or after the last
+ * tick leave *seg right.
+ */
+MIDIFILE_PUBLIC uint64_t
+mf_tempo_map_next(const struct mf_tempo_map *m, mf_ticks_t tick, int *seg,
+        uint64_t *rem) {
+    int i = *seg;
+
+    while (i + 1 < m->nsegs && m->segs[i + 1].tick <= tick)
+        i++;
+    *seg = i;
+    return(timeat(m, i, tick, rem));
+}
+
+/* the tick at us, rounded down */
 MIDIFILE_PUBLIC mf_ticks_t
-mf_sec2ticks(float secs, int division, unsigned int tempo) {    
-    return (long)(((secs * 1000.0) / 4.0 * division) / tempo);
+mf_tempo_map_ticks(const struct mf_tempo_map *m, uint64_t us) {
+    const struct mf_tempo_seg *s;
+    uint64_t t, step, n;
+    int lo = 0, hi = m->nsegs - 1, mid;
+
+    if (us > UINT64_MAX / m->scale)
+        return(UINT32_MAX);
+    t = us * m->scale;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (m->segs[mid].time <= t)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    s = &m->segs[lo];
+    if ((step = m->step ? m->step : s->tempo) == 0)
+        return(s->tick);
+    n = s->tick + (t - s->time) / step;
+    return(n > UINT32_MAX ? UINT32_MAX : (mf_ticks_t)n);
 }
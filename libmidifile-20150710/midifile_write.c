@@ -43,7 +43,8 @@
  */
 
 #include <stdio.h>
-#include <stdlib.h>			/* exit */
+#include <stdlib.h>			/* realloc, exit */
+#include <string.h>
 
 #include "midifile.h"
 
@@ -58,60 +59,134 @@
 MIDIFILE_WRITE_FUNCTIONS
 #undef MIDIFILE_FUNC
 
-/* 1 => continued system exclusives are not collapsed */
-MIDIFILE_PUBLIC int Mf_nomerge = 0;
-
-/* current time in delta‐time units */
-MIDIFILE_PUBLIC mf_deltat_t Mf_currtime = 0;
-
 /* PLB: log output to stderr */
 MIDIFILE_PUBLIC int Mf_trace_output = 0;
 
-#define TRACE_FUNC if (Mf_trace_output) fprintf(stderr, "%s\n", __func__)
-#define TRACE_EOL if (Mf_trace_output) fprintf(stderr, "\n")
+MIDIFILE_PUBLIC int Mf_RunStat = 0;    /* if nonzero, use running status */
+
+#define TRACE_FUNC if (w->trace_output) fprintf(stderr, "%s\n", __func__)
+#define TRACE_EOL if (w->trace_output) fprintf(stderr, "\n")
 
 /* private stuff */
-static mf_ssize_t Mf_numbyteswritten = 0;
+
+/*
+ * All writer state lives in a struct mf_writer (see midifile.h), so
+ * any number of files can be written at once.  mfwrite() and the
+ * mf_w_* functions use this one, with handlers that call the Mf_*
+ * function pointers above.
+ */
+static struct mf_writer Mf_writer;
 
 static void
-mferror(char *s) {
-    if (Mf_werror)
-        Mf_werror(s);
-    exit(1);
+mferror(struct mf_writer *w, char *s) {
+    snprintf(w->err.reason, sizeof(w->err.reason), "%s", s);
+    w->err.offset = w->offset + w->outleng;
+    w->err.track = w->track;
+    if (w->Mf_werror)
+        w->Mf_werror(w, s);
+    if (!w->catching)
+        exit(1);
+    w->catching = 0;
+    if (w->outleng > w->trackat)	/* drop the unfinished track */
+	w->outleng = w->trackat;
+    longjmp(w->jump, 1);
 }
 
-/* write a single character and abort on error */
-static int
-_eputc(unsigned char c) {
-    int return_val;
+/*
+ * With noexit set, the entry points below catch errors here: mferror()
+ * longjmps back, and the entry point returns -1.  The mf_w_*_r() event
+ * functions catch their own only when called outside an entry point
+ * (between mf_w_track_begin_r() and mf_w_track_end_r()); from inside
+ * Mf_wtrack, the error goes back to mf_w_track_r().
+ */
+#define CATCH(w) \
+    memset(&(w)->err, 0, sizeof((w)->err)); \
+    if ((w)->noexit) { \
+	if (setjmp((w)->jump)) \
+	    return(-1); \
+	(w)->catching = 1; \
+    }
 
-    if ((Mf_putc) == NULL) {
-        mferror("Mf_putc undefined");
-        return(-1);
+#define CATCH_EVENT(w, outer) \
+    if (!((outer) = (w)->catching)) { \
+	CATCH(w); \
     }
 
-    if (Mf_trace_output)
-	fprintf(stderr, " %02X", c);
-    return_val = Mf_putc(c);
+#define UNCATCH_EVENT(w, outer) \
+    if (!(outer)) \
+	(w)->catching = 0
+
+/*
+ * Output is collected in outbuf and passed on a chunk at a time, so
+ * the length of a track can be filled in before it is written without
+ * seeking, and the whole chunk goes out in one Mf_putbuf call.
+ */
+
+/* make room for n more bytes in outbuf */
+static void
+outroom(struct mf_writer *w, mf_size_t n) {
+    if (n > (mf_size_t)-1 - w->outleng)
+	mferror(w, "outroom: too much output");
+    if (w->outleng + n > w->outsize) {
+	mf_size_t size = w->outsize;
+	mf_data_t *p;
+
+	do
+	    size = size == 0 ? 1024 :
+		size > (mf_size_t)-1 / 2 ? w->outleng + n : 2 * size;
+	while (w->outleng + n > size);
+	if ((p = realloc(w->outbuf, size)) == NULL)
+	    mferror(w, "outroom: realloc failed!");
+	if (w->stats)
+	    w->stats->reallocs++;
+	w->outbuf = p;
+	w->outsize = size;
+    }
+}
 
-    if (return_val == EOF)
-        mferror("error writing");
+/* pass the contents of outbuf on and abort on error */
+static void
+flush(struct mf_writer *w) {
+    mf_size_t i, n = w->outleng;
+
+    w->outleng = 0;			/* for mferror(), it isn’t written */
+    if (w->Mf_putbuf) {
+	if (n > 0 && w->Mf_putbuf(w, w->outbuf, n) != (int)n)
+	    mferror(w, "error writing");
+    } else if (w->Mf_putc) {
+	for (i = 0; i < n; i++)
+	    if (w->Mf_putc(w, w->outbuf[i]) == EOF)
+		mferror(w, "error writing");
+    } else
+	mferror(w, "Mf_putc undefined");
+    w->offset += n;
+    if (w->stats)
+	w->stats->bytes += n;
+}
 
-    Mf_numbyteswritten++;
-    return(return_val);
+/* write a single character */
+static int
+_eputc(struct mf_writer *w, unsigned char c) {
+    if (w->trace_output)
+	fprintf(stderr, " %02X", c);
+    outroom(w, 1);
+    w->outbuf[w->outleng++] = c;
+
+    w->numbyteswritten++;
+    return(c);
 }
 
 static int
-__eputc(const char *what, unsigned char c) {
+__eputc(struct mf_writer *w, const char *what, unsigned char c) {
     int ret;
-    if (Mf_trace_output)
+    if (w->trace_output)
 	fprintf(stderr, " %s =>", what);
-    ret = _eputc(c);
+    ret = _eputc(w, c);
     TRACE_EOL;
     return(ret);
 } /* __eputc */
 
-#define eputc(X) __eputc(#X, X)
+#define eputc(X) __eputc(w, #X, X)
 
 /*
  * write32bit()
@@ -123,30 +198,30 @@ __eputc(const char *what, unsigned char c) {
  * to the next.
  */
 static void
-_write32bit(const char *what, int32_t data) {
-    if (Mf_trace_output)
+_write32bit(struct mf_writer *w, const char *what, int32_t data) {
+    if (w->trace_output)
 	fprintf(stderr, " %s =>", what);
-    _eputc((unsigned)((data >> 24) & 0xff));
-    _eputc((unsigned)((data >> 16) & 0xff));
-    _eputc((unsigned)((data >> 8 ) & 0xff));
-    _eputc((unsigned)(data & 0xff));
+    _eputc(w, (unsigned)((data >> 24) & 0xff));
+    _eputc(w, (unsigned)((data >> 16) & 0xff));
+    _eputc(w, (unsigned)((data >> 8 ) & 0xff));
+    _eputc(w, (unsigned)(data & 0xff));
     TRACE_EOL;
 }
 
 static void
-_write16bit(const char *what, int data) {
-    if (Mf_trace_output)
+_write16bit(struct mf_writer *w, const char *what, int data) {
+    if (w->trace_output)
 	fprintf(stderr, " %s =>", what);
-    _eputc((unsigned)((data & 0xff00) >> 8));
-    _eputc((unsigned)(data & 0xff));
+    _eputc(w, (unsigned)((data & 0xff00) >> 8));
+    _eputc(w, (unsigned)(data & 0xff));
     TRACE_EOL;
 }
 
 static void
-_WriteVarLen(const char *what, mf_varinum_t value) {
-    mf_varinum_t buffer;
+_WriteVarLen(struct mf_writer *w, const char *what, mf_varinum_t value) {
+    uint64_t buffer;		/* 5 bytes for values of 2^28 and up */
 
-    if (Mf_trace_output)
+    if (w->trace_output)
 	fprintf(stderr, " %s =>", what);
     buffer = value & 0x7f;
     while ((value >>= 7) > 0) {
@@ -155,7 +230,7 @@ _WriteVarLen(const char *what, mf_varinum_t value) {
         buffer += (value & 0x7f);
     }
     while (1) {
-        _eputc((unsigned)(buffer & 0xff));
+        _eputc(w, (unsigned)(buffer & 0xff));
        
         if (buffer & 0x80)
             buffer >>= 8;
@@ -165,12 +240,12 @@ _WriteVarLen(const char *what, mf_varinum_t value) {
     TRACE_EOL;
 } /* end of WriteVarLen */
 
-#define write32bit(X) _write32bit(#X, X)
-#define write16bit(X) _write16bit(#X, X)
-#define WriteVarLen(X) _WriteVarLen(#X, X)
+#define write32bit(X) _write32bit(w, #X, X)
+#define write16bit(X) _write16bit(w, #X, X)
+#define WriteVarLen(X) _WriteVarLen(w, #X, X)
 
 static void
-mf_w_header_chunk(int format, int ntracks, int division) {
+mf_w_header_chunk(struct mf_writer *w, int format, int ntracks, int division) {
     uint32_t ident,length;
     
     ident = MThd;           /* Head chunk identifier */
@@ -186,16 +261,20 @@ mf_w_header_chunk(int format, int ntracks, int division) {
     write16bit(division);
 } /* end gen_header_chunk() */
 
-MIDIFILE_PUBLIC int Mf_RunStat = 0;    /* if nonzero, use running status */
-static int laststat;                   /* last status code */
-static int lastmeta;                   /* last meta event type */
-
 static void
-mf_write_data(mf_data_t *data, mf_size_t size) {
-    if (Mf_trace_output)
-	fprintf(stderr, " data =>");
+mf_write_data(struct mf_writer *w, mf_data_t *data, mf_size_t size) {
+    if (!w->trace_output) {
+	if (size == 0)		/* data may be NULL */
+	    return;
+	outroom(w, size);
+	memcpy(w->outbuf + w->outleng, data, size);
+	w->outleng += size;
+	w->numbyteswritten += size;
+	return;
+    }
+    fprintf(stderr, " data =>");
     while (size-- > 0)
-        _eputc(*data++);
+        _eputc(w, *data++);
     TRACE_EOL;
 }
 
@@ -218,12 +297,13 @@ mf_write_data(mf_data_t *data, mf_size_t size) {
  * size – The length of the midi‐event data.
  */
 MIDIFILE_PUBLIC int
-mf_w_midi_event(mf_deltat_t delta_time,
+mf_w_midi_event_r(struct mf_writer *w, mf_deltat_t delta_time,
         unsigned int type, unsigned int chan, mf_data_t *data,
         mf_size_t size) {
     unsigned char c;
-    int ret = size;
+    int outer;
 
+    CATCH_EVENT(w, outer);
     TRACE_FUNC;
     WriteVarLen(delta_time);
 
@@ -231,18 +311,19 @@ mf_w_midi_event(mf_deltat_t delta_time,
        and the channel in the lower four bits */
     c = type | chan;
 
-    if (chan > 15) {
+    if (chan > 15)
         fprintf(stderr, "error: MIDI channel greater than 16\n");
-	ret = -1;
-    }
-    if (!Mf_RunStat || laststat != c)
-        __eputc("status", c);
+    if (!w->runstat || w->laststat != c)
+        __eputc(w, "status", c);
 
-    laststat = c;
+    w->laststat = c;
+    if (w->stats)
+	mf_stats_count(w->stats, c);
 
     /* write out the data bytes */
-    mf_write_data(data, size);
-    return(ret);
+    mf_write_data(w, data, size);
+    UNCATCH_EVENT(w, outer);
+    return(chan > 15 ? -1 : (int)size);
 } /* end mf_write MIDI event */
 
 /*
@@ -260,26 +341,30 @@ mf_w_midi_event(mf_deltat_t delta_time,
  * size – The length of the meta‐event data.
  */
 MIDIFILE_PUBLIC int
-mf_w_meta_event(mf_deltat_t delta_time, unsigned int type,
-		mf_data_t *data, mf_size_t size) {
-    int ret = size;
+mf_w_meta_event_r(struct mf_writer *w, mf_deltat_t delta_time,
+		unsigned int type, mf_data_t *data, mf_size_t size) {
+    int outer;
 
+    CATCH_EVENT(w, outer);
     TRACE_FUNC;
     WriteVarLen(delta_time);
     
     /* This marks the fact we’re writing a meta‐event */
     eputc(meta_event);
-    laststat = meta_event;
+    w->laststat = meta_event;
 
     /* The type of meta event */
     eputc(type);
-    lastmeta = type;
+    w->lastmeta = type;
+    if (w->stats)
+	mf_stats_count(w->stats, meta_event);
 
     /* The length of the data bytes to follow */
     WriteVarLen(size); 
 
-    mf_write_data(data, size);
-    return(ret);
+    mf_write_data(w, data, size);
+    UNCATCH_EVENT(w, outer);
+    return(size);
 } /* end mf_w_meta_event */
 
 /*
@@ -296,113 +381,162 @@ mf_w_meta_event(mf_deltat_t delta_time, unsigned int type,
  * size – The length of the sysex‐event data.
  */
 MIDIFILE_PUBLIC int
-mf_w_sysex_event(mf_deltat_t delta_time,
+mf_w_sysex_event_r(struct mf_writer *w, mf_deltat_t delta_time,
         mf_data_t *data, mf_size_t size) {
-    int ret = size;
+    int outer;
 
+    CATCH_EVENT(w, outer);
     TRACE_FUNC;
     WriteVarLen(delta_time);
     
     /* The type of sysex event */
-    __eputc("event", *data);
-    laststat = 0;
+    __eputc(w, "event", *data);
+    w->laststat = 0;
+    if (w->stats)
+	mf_stats_count(w->stats, *data);
 
     /* The length of the data bytes to follow */
     WriteVarLen(size-1); 
-    mf_write_data(data, size);
+    mf_write_data(w, data + 1, size - 1);
 
-    return(ret);
+    UNCATCH_EVENT(w, outer);
+    return(size);
 } /* end mf_w_sysex_event */
 
-MIDIFILE_PUBLIC void
-mf_w_tempo(mf_deltat_t delta_time, mf_tempo_t tempo) {
+MIDIFILE_PUBLIC int
+mf_w_tempo_r(struct mf_writer *w, mf_deltat_t delta_time, mf_tempo_t tempo) {
+    int outer;
+
     /* Write tempo */
     /* all tempos are written as 120 beats/minute, */
     /* expressed in microseconds/quarter note     */
 
+    CATCH_EVENT(w, outer);
     WriteVarLen(delta_time);
 
     eputc(meta_event);
-    laststat = meta_event;
+    w->laststat = meta_event;
     eputc(set_tempo);
+    if (w->stats)
+	mf_stats_count(w->stats, meta_event);
 
     eputc(3);
-    if (Mf_trace_output)
+    if (w->trace_output)
 	fprintf(stderr, " tempo =>");
-    _eputc((unsigned)(0xff & (tempo >> 16)));
-    _eputc((unsigned)(0xff & (tempo >> 8)));
-    _eputc((unsigned)(0xff & tempo));
+    _eputc(w, (unsigned)(0xff & (tempo >> 16)));
+    _eputc(w, (unsigned)(0xff & (tempo >> 8)));
+    _eputc(w, (unsigned)(0xff & tempo));
     TRACE_EOL;
+    UNCATCH_EVENT(w, outer);
+    return(0);
 }
 
+/* begin a track chunk in outbuf */
 static void
-mf_w_track_chunk(int tempo_track, FILE *fp) {
+trackbegin(struct mf_writer *w) {
     uint32_t trkhdr,trklength;
-    long offset, place_marker;
 
     trkhdr = MTrk;
     trklength = 0;
+    w->track++;
+    if (w->stats)
+	w->stats->tracks++;
 
     /* Remember where the length was written, because we don’t
        know how long it will be until we’ve finished writing */
-    offset = ftell(fp); 
-
-#ifdef DEBUG
-    printf("offset = %d\n",(int) offset);
-#endif
+    w->trackat = w->outleng;
 
     /* Write the track chunk header */
     write32bit(trkhdr);
     write32bit(trklength);
 
-    Mf_numbyteswritten = 0L; /* the header’s length doesn’t count */
-    laststat = 0;
+    w->numbyteswritten = 0L; /* the header’s length doesn’t count */
+    w->laststat = 0;
+}
 
-    /* "wtempotrack -1 is harmless" */
-    if (tempo_track)
-        Mf_wtempotrack(-1);
-    else
-        Mf_wtrack();
+/* end the track chunk begun in outbuf, and pass it on */
+static void
+trackend(struct mf_writer *w) {
+    uint32_t trklength;
+    mf_size_t offset = w->trackat;
 
-    if (laststat != meta_event || lastmeta != end_of_track) {
+    if (w->laststat != meta_event || w->lastmeta != end_of_track) {
         /* mf_write End of track meta event */
         eputc(0);
         eputc(meta_event);
         eputc(end_of_track);
         eputc(0);
+	if (w->stats)
+	    mf_stats_count(w->stats, meta_event);
     }
 
-    laststat = 0;
+    w->laststat = 0;
      
     /* It’s impossible to know how long the track chunk will be beforehand,
        so the position of the track length data is kept so that it can
-       be written after the chunk has been generated */
-    place_marker = ftell(fp);
+       be filled in, still in outbuf, after the chunk has been generated */
+    trklength = w->numbyteswritten;
+    w->outbuf[offset + 4] = (trklength >> 24) & 0xff;
+    w->outbuf[offset + 5] = (trklength >> 16) & 0xff;
+    w->outbuf[offset + 6] = (trklength >> 8) & 0xff;
+    w->outbuf[offset + 7] = trklength & 0xff;
+    if (w->trace_output)
+	fprintf(stderr, " trklength = %u\n", (unsigned)trklength);
+
+    flush(w);
+}
 
-    /* This method turned out not to be portable because the
-       parameter returned from ftell is not guaranteed to be
-       in bytes on every machine */
-    /* track.length = place_marker - offset - (long) sizeof(track); */
+static void
+mf_w_track_chunk(struct mf_writer *w, int tempo_track) {
+    trackbegin(w);
 
-#ifdef DEBUG
-    printf("length = %d\n",(int) trklength);
-#endif
+    /* "wtempotrack -1 is harmless" */
+    if (tempo_track)
+        w->Mf_wtempotrack(w, -1);
+    else
+        w->Mf_wtrack(w);
 
-    if (fseek(fp,offset,0) < 0)
-        mferror("error seeking during final stage of write");
+    trackend(w);
+} /* End gen_track_chunk() */
 
-    trklength = Mf_numbyteswritten;
+static void
+writeheader(struct mf_writer *w, int format, int ntracks, int division) {
+    if (w->Mf_putc == NULL && w->Mf_putbuf == NULL)
+        mferror(w, "mfwrite_r() called without setting Mf_putc");
 
-    /* Re‐mf_write the track chunk header with right length */
-    write32bit(trkhdr);
-    write32bit(trklength);
+    /* every MIDI file starts with a header */
+    w->outleng = 0;
+    w->offset = 0;
+    w->track = 0;
+    mf_w_header_chunk(w, format,ntracks,division);
+    flush(w);
+}
 
-    fseek(fp,place_marker,0);
-} /* End gen_track_chunk() */
+static void
+writefile(struct mf_writer *w, int format, int ntracks, int division) {
+    int i;
+
+    if (w->Mf_wtrack == NULL)
+        mferror(w, "mfwrite_r() called without setting Mf_wtrack"); 
+
+    writeheader(w, format, ntracks, division);
+
+    /* In format 1 files, the first track is a tempo map */
+    if (format == 1 && w->Mf_wtempotrack) {
+        mf_w_track_chunk(w, 1);
+        ntracks--;
+    }
+
+    /* The rest of the file is a series of tracks */
+    for (i = 0; i < ntracks; i++)
+        mf_w_track_chunk(w, 0);
+}
 
 /*
- * mfwrite() – The only function you’ll need to call to write out
- *             a midi file.
+ * mfwrite_r() – The only function you’ll need to call to write out
+ *             a midi file (mfwrite() for the Mf_* handlers).
+ *
+ * w           The writer, with at least Mf_putc and Mf_wtrack set.
  *
  * format      0 – Single multi‐channel track
  *             1 – Multiple simultaneous tracks
@@ -424,31 +558,161 @@ mf_w_track_chunk(int tempo_track, FILE *fp) {
  *             consisting  of  bits 7 through 0 corresponds the the
  *             resolution within a frame.  Refer the Standard MIDI
  *             Files 1.0 spec for more details.
- * fp          This should be the open file pointer to the file you
- *             want to write.  It will have be a global in order
- *             to work with Mf_putc.  
+ * fp          The file being written.  The library no longer seeks
+ *             on it; all output goes through Mf_putbuf, or Mf_putc
+ *             if that is not set, a whole chunk at a time, so it may
+ *             be a pipe.
  */ 
 
+MIDIFILE_PUBLIC int
+mfwrite_r(struct mf_writer *w, int format, int ntracks, int division,
+        FILE *fp) {
+    (void) fp;
+    CATCH(w);
+    writefile(w, format, ntracks, division);
+    w->catching = 0;
+    return(0);
+}
+
+/*
+ * The pieces of mfwrite_r(): write the header chunk, or one track
+ * chunk (calling Mf_wtrack for its events).  Each chunk is passed on
+ * whole before these return, and a track depends on nothing written
+ * before it, so separate writers may produce the tracks of one file at
+ * the same time for the caller to put together in order; set offset
+ * and track first for errors to say where they are.
+ */
+MIDIFILE_PUBLIC int
+mf_w_header_r(struct mf_writer *w, int format, int ntracks, int division) {
+    CATCH(w);
+    writeheader(w, format, ntracks, division);
+    w->catching = 0;
+    return(0);
+}
+
+MIDIFILE_PUBLIC int
+mf_w_track_r(struct mf_writer *w) {
+    CATCH(w);
+    if (w->Mf_wtrack == NULL)
+        mferror(w, "mfwrite_r() called without setting Mf_wtrack"); 
+
+    mf_w_track_chunk(w, 0);
+    w->catching = 0;
+    return(0);
+}
+
+/*
+ * mf_w_track_r() in two: the events of the track are written in
+ * between, and kept in outbuf until mf_w_track_end_r() passes the
+ * chunk on.  So a writer each can build several tracks at once.
+ */
+MIDIFILE_PUBLIC int
+mf_w_track_begin_r(struct mf_writer *w) {
+    CATCH(w);
+    trackbegin(w);
+    w->catching = 0;
+    return(0);
+}
+
+MIDIFILE_PUBLIC int
+mf_w_track_end_r(struct mf_writer *w) {
+    CATCH(w);
+    trackend(w);
+    w->catching = 0;
+    return(0);
+}
+
 MIDIFILE_PUBLIC void
-mfwrite(int format, int ntracks, int division, FILE *fp) {
-    int i;
+mf_writer_init(struct mf_writer *w) {
+    memset(w, 0, sizeof(*w));
+}
 
-    if (Mf_putc == NULL)
-        mferror("mfmf_write() called without setting Mf_putc");
+/* release the output buffer; the writer may be used again */
+MIDIFILE_PUBLIC void
+mf_writer_free(struct mf_writer *w) {
+    free(w->outbuf);
+    w->outbuf = NULL;
+    w->outsize = w->outleng = 0;
+}
 
-    if (Mf_wtrack == NULL)
-        mferror("mfmf_write() called without setting Mf_mf_writetrack"); 
+/*
+ * Compatibility: handlers for Mf_writer that call the corresponding
+ * Mf_* function, and the original entry points that write through it.
+ */
 
-    /* every MIDI file starts with a header */
-    mf_w_header_chunk(format,ntracks,division);
+static int
+compat_putc(struct mf_writer *w, int c) {
+    (void) w;
+    return Mf_putc(c);
+}
 
-    /* In format 1 files, the first track is a tempo map */
-    if (format == 1 && Mf_wtempotrack) {
-        mf_w_track_chunk(1, fp);
-        ntracks--;
-    }
+static int
+compat_putbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    (void) w;
+    return Mf_putbuf(buf, size);
+}
 
-    /* The rest of the file is a series of tracks */
-    for (i = 0; i < ntracks; i++)
-        mf_w_track_chunk(0, fp);
+static void
+compat_wtrack(struct mf_writer *w) {
+    (void) w;
+    Mf_wtrack();
+}
+
+static void
+compat_wtempotrack(struct mf_writer *w, int track) {
+    (void) w;
+    Mf_wtempotrack(track);
+}
+
+static void
+compat_werror(struct mf_writer *w, char *s) {
+    (void) w;
+    Mf_werror(s);
+}
+
+/* point Mf_writer at the compat_* handler for each Mf_* that is set */
+static struct mf_writer *
+compat_writer(void) {
+    struct mf_writer *w = &Mf_writer;
+
+#define COMPAT(NAME) w->Mf_##NAME = Mf_##NAME ? compat_##NAME : NULL
+    COMPAT(putc);
+    COMPAT(putbuf);
+    COMPAT(wtrack);
+    COMPAT(wtempotrack);
+    COMPAT(werror);
+#undef COMPAT
+    w->runstat = Mf_RunStat;
+    w->trace_output = Mf_trace_output;
+    return(w);
+}
+
+MIDIFILE_PUBLIC void
+mfwrite(int format, int ntracks, int division, FILE *fp) {
+    mfwrite_r(compat_writer(), format, ntracks, division, fp);
+}
+
+MIDIFILE_PUBLIC int
+mf_w_midi_event(mf_deltat_t delta_time,
+        unsigned int type, unsigned int chan, mf_data_t *data,
+        mf_size_t size) {
+    return mf_w_midi_event_r(compat_writer(), delta_time, type, chan,
+            data, size);
+}
+
+MIDIFILE_PUBLIC int
+mf_w_meta_event(mf_deltat_t delta_time, unsigned int type,
+		mf_data_t *data, mf_size_t size) {
+    return mf_w_meta_event_r(compat_writer(), delta_time, type, data, size);
+}
+
+MIDIFILE_PUBLIC int
+mf_w_sysex_event(mf_deltat_t delta_time,
+        mf_data_t *data, mf_size_t size) {
+    return mf_w_sysex_event_r(compat_writer(), delta_time, data, size);
+}
+
+MIDIFILE_PUBLIC void
+mf_w_tempo(mf_deltat_t delta_time, mf_tempo_t tempo) {
+    mf_w_tempo_r(compat_writer(), delta_time, tempo);
 }
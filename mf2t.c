@@ -10,222 +10,544 @@
 #include <string.h>
 #if _POSIX_C_SOURCE >= 2
 #include <unistd.h>
+#include <sys/mman.h>
 #else
 #include <io.h>
 #include "getopt.h"
 #endif
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "midifile.h"
+#include "batch.h"
+#include "mfcheck.h"
+#include "partrack.h"
+#include "stats.h"
 #include "version.h"
 
-static int TrkNr;
-static int TrksToDo = 1;
-static int Measure, M0, Beat, Clicks;
-static mf_deltat_t T0;
+/* -M: an event of a track whose text is waiting to be merged */
+struct queued {
+    mf_deltat_t time;
+    size_t start;		/* of its text in buf */
+};
+
+/*
+ * Where the text for a track goes, and the running state needed to
+ * print it.  Tracks decoded in parallel each get their own copy, and
+ * so do those being merged.
+ */
+struct mf2t {
+    FILE *in;			/* the MIDI file */
+    const char *name;		/* and its name, in batch mode */
+    FILE *out;			/* NULL: keep all the text in buf */
+    char *buf;			/* text not yet written */
+    size_t leng;		/* bytes in buf */
+    size_t size;		/* size of currently allocated buf */
+    size_t written;		/* text written out before buf */
+    int failed;			/* 1 => the file can’t be converted */
+    int times;			/* as the option, but off for SMPTE */
+    int trknr;
+    int trkstodo;
+    int measure, m0, beat;
+    int clicks;
+    mf_deltat_t t0;
+    int format;
+    struct mf_tempo_map *map;	/* -u, -s: the Tempos so far, or NULL */
+    int seg;			/* the segment of map the track is up to */
+    int premapped;		/* map has every track’s Tempos already */
+    int merging;		/* -M: queue the events, without times */
+    struct queued *queue;	/* the events in buf */
+    int nqueued, maxqueued;
+    int next;			/* the first not yet merged */
+    struct stats *st;		/* -S: what is counted for the file */
+    struct mf_stats *counts;	/* the reader’s, for buf growing too */
+    double trkstart;		/* when this track was begun */
+    uint64_t trkevents;		/* the events counted by then */
+    size_t trktext;		/* and the text */
+};
 
 /* options */
 
 static int fold = 0;		/* fold long lines */
 static int notes = 0;		/* print notes as a–g */
 static int times = 0;		/* print times as Measure/beat/click */
+static int realtime = 0;	/* print times in µs (1) or seconds (2) */
+static int merge = 0;		/* merge the tracks in time order */
+static int nomerge = 1;		/* don’t merge partial sysex */
+static int jobs = 1;		/* tracks (files, in batch mode) at once */
+#ifndef MFCHECK
+static int batch = 0;		/* convert many files */
+static const char *outdir;	/* where batch mode puts the text */
+static FILE *Statsfp;		/* -S: where to write the statistics */
+#else
+static int batch = 1;		/* mfcheck does, so don’t exit */
+#endif
+
+/* the text around the numbers of the channel messages (-v changes it) */
+static const char *Onmsg[]  = { "On ch=", " n=", " v=" };
+static const char *Offmsg[] = { "Off ch=", " n=", " v=" };
+static const char *PoPrmsg[] = { "PoPr ch=", " n=", " v=" };
+static const char *Parmsg[] = { "Par ch=", " c=", " v=" };
+static const char *Pbmsg[]  = { "Pb ch=", " v=" };
+static const char *PrChmsg[] = { "PrCh ch=", " p=" };
+static const char *ChPrmsg[] = { "ChPr ch=", " v=" };
+
+static const char Hex[] = "0123456789abcdef";
+static char Notenames[256][6];	/* "c#10" etc., see mknotes() */
+
+/*
+ * Output.  The text is put together in t->buf by the functions below,
+ * which do what printf would but much more cheaply, and written out in
+ * large blocks.  A track decoded by a worker stays in t->buf whole.
+ */
+
+#define OUTBUFSIZE 65536
+#define BLOCKSIZE 65536		/* of input from a pipe */
+
+/* write n bytes of text out */
+static void
+output(struct mf2t *t, const char *buf, size_t n) {
+    double start = t->st ? stats_now() : 0;
+
+    fwrite(buf, 1, n, t->out);
+    t->written += n;
+    if (t->st)
+        t->st->write += stats_now() - start;
+}
+
+/* write the text out; with no out to write it to, it is all kept */
+static void
+flush(struct mf2t *t) {
+    if (t->out == NULL)
+        return;
+    if (t->leng > 0)
+        output(t, t->buf, t->leng);
+    t->leng = 0;
+}
+
+/* make room for n more bytes of text and return where they go */
+static char *
+room(struct mf2t *t, size_t n) {
+    if (t->leng + n > t->size && t->out)
+        flush(t);
+    if (t->leng + n > t->size) {
+        do
+            t->size = t->size ? 2 * t->size : OUTBUFSIZE;
+        while (t->leng + n > t->size);
+        if ((t->buf = realloc(t->buf, t->size)) == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        if (t->counts)
+            t->counts->reallocs++;
+    }
+    return(t->buf + t->leng);
+}
+
+static void
+outc(struct mf2t *t, int c) {
+    *room(t, 1) = c;
+    t->leng++;
+}
+
+static void
+outs(struct mf2t *t, const char *s) {
+    size_t n = strlen(s);
+
+    memcpy(room(t, n), s, n);
+    t->leng += n;
+}
+
+/* as printf("%d", n) */
+static void
+outd(struct mf2t *t, int n) {
+    char tmp[12], *p = tmp + sizeof(tmp);
+    unsigned int u = n < 0 ? -(unsigned int)n : (unsigned int)n;
 
-static char *Onmsg  = "On ch=%d n=%s v=%d\n";
-static char *Offmsg = "Off ch=%d n=%s v=%d\n";
-static char *PoPrmsg = "PoPr ch=%d n=%s v=%d\n";
-static char *Parmsg = "Par ch=%d c=%d v=%d\n";
-static char *Pbmsg  = "Pb ch=%d v=%d\n";
-static char *PrChmsg = "PrCh ch=%d p=%d\n";
-static char *ChPrmsg = "ChPr ch=%d v=%d\n";
+    do
+        *--p = '0' + u % 10;
+    while ((u /= 10) > 0);
+    if (n < 0)
+        *--p = '-';
+    memcpy(room(t, tmp + sizeof(tmp) - p), p, tmp + sizeof(tmp) - p);
+    t->leng += tmp + sizeof(tmp) - p;
+}
+
+/* as printf("%llu", n) */
+static void
+outu(struct mf2t *t, uint64_t n) {
+    char tmp[20], *p = tmp + sizeof(tmp);
+
+    do
+        *--p = '0' + n % 10;
+    while ((n /= 10) > 0);
+    memcpy(room(t, tmp + sizeof(tmp) - p), p, tmp + sizeof(tmp) - p);
+    t->leng += tmp + sizeof(tmp) - p;
+}
+
+/* as printf("%02x", c) */
+static void
+outx(struct mf2t *t, int c) {
+    char *o = room(t, 2);
+
+    o[0] = Hex[(c >> 4) & 0xf];
+    o[1] = Hex[c & 0xf];
+    t->leng += 2;
+}
 
 static void
-error(char *s) {
-    if (TrksToDo <= 0)
-        fprintf(stderr, "Error: Garbage at end\n");
+error(struct mf_reader *r, char *s) {
+    struct mf2t *t = r->data;
+
+    flush(t);			/* the library will exit, unless batch */
+    if (t->trkstodo <= 0)
+        s = "Garbage at end";
+    if (t->name)
+        fprintf(stderr, "%s: Error: %s\n", t->name, s);
     else
         fprintf(stderr, "Error: %s\n", s);
 }
 
+/* the time of an event, as the options say */
 static void
-prtime(void) {
-    if (times) {
-        mf_deltat_t m = (Mf_currtime-T0)/Beat;
-        printf("%d:%d:%d ",
-                m/Measure+M0, m%Measure, (Mf_currtime-T0)%Beat);
+outtime(struct mf2t *t, mf_deltat_t time) {
+    uint64_t us;
+    char *o;
+    int i;
+
+    if (t->map) {
+        us = mf_tempo_map_next(t->map, time, &t->seg, NULL);
+        if (realtime == 1)
+            outu(t, us);
+        else {
+            outu(t, us / 1000000);
+            o = room(t, 7);
+            *o = '.';
+            for (i = 6, us %= 1000000; i > 0; i--, us /= 10)
+                o[i] = '0' + us % 10;
+            t->leng += 7;
+        }
+    } else if (t->times) {
+        mf_deltat_t m = (time-t->t0)/t->beat;
+        outd(t, m/t->measure+t->m0);
+        outc(t, ':');
+        outd(t, m%t->measure);
+        outc(t, ':');
+        outd(t, (time-t->t0)%t->beat);
     } else
-        printf("%d ",Mf_currtime);
+        outd(t, time);
+    outc(t, ' ');
+}
+
+/* an event begins: its time, or with -M, where its text starts */
+static void
+prtime(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+    struct queued *more;
+    int size;
+
+    if (!t->merging) {
+        outtime(t, r->currtime);
+        return;
+    }
+    if (t->nqueued == t->maxqueued) {
+        size = t->maxqueued ? 2 * t->maxqueued : 64;
+        if ((more = realloc(t->queue, size * sizeof(*more))) == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        if (t->counts)
+            t->counts->reallocs++;
+        t->queue = more;
+        t->maxqueued = size;
+    }
+    t->queue[t->nqueued].time = r->currtime;
+    t->queue[t->nqueued++].start = t->leng;
 }
 
 static void
-prtext(unsigned char *p, int leng) {
+prtext(struct mf2t *t, unsigned char *p, int leng) {
     int n, c;
     int pos = 25;
+    char *o = room(t, 8 * (size_t)leng + 3);	/* \ \n \t \ \xab each */
 
-    printf("\"");
+    *o++ = '"';
     for (n = 0; n < leng; n++) {
         c = *p++;
         if (fold && pos >= fold) {
-            printf("\\\n\t");
+            *o++ = '\\';
+            *o++ = '\n';
+            *o++ = '\t';
             pos = 13;	/* tab + \xab + \ */
             if (c == ' ' || c == '\t') {
-                putchar('\\');
+                *o++ = '\\';
                 ++pos;
             }
         }
         switch (c) {
             case '\\':
             case '"':
-                printf("\\%c", c);
+                *o++ = '\\';
+                *o++ = c;
                 pos += 2;
                 break;
             case '\r':
-                printf("\\r");
+                *o++ = '\\';
+                *o++ = 'r';
                 pos += 2;
                 break;
             case '\n':
-                printf("\\n");
+                *o++ = '\\';
+                *o++ = 'n';
                 pos += 2;
                 break;
             case '\0':
-                printf("\\0");
+                *o++ = '\\';
+                *o++ = '0';
                 pos += 2;
                 break;
             default:
                 if (c >= 0x20) {
-                    putchar(c);
+                    *o++ = c;
                     ++pos;
                 } else {
-                    printf("\\x%02x" , c);
+                    *o++ = '\\';
+                    *o++ = 'x';
+                    *o++ = Hex[c >> 4];
+                    *o++ = Hex[c & 0xf];
                     pos += 4;
                 }
         }
     }
-    printf("\"\n");
+    *o++ = '"';
+    *o++ = '\n';
+    t->leng = o - t->buf;
 }
 
 static void
-prhex(unsigned char *p,  int leng) {
+prhex(struct mf2t *t, unsigned char *p,  int leng) {
     int n;
     int pos = 25;
+    char *o = room(t, 5 * (size_t)leng + 1);	/* \ \n \t ab each */
 
     for (n = 0; n < leng; n++, p++) {
         if (fold && pos >= fold) {
-            printf("\\\n\t%02x", *p);
+            *o++ = '\\';
+            *o++ = '\n';
+            *o++ = '\t';
             pos = 14;	/* tab + ab + " ab" + \ */
         } else {
-            printf(" %02x" , *p);
+            *o++ = ' ';
             pos += 3;
         }
+        *o++ = Hex[*p >> 4];
+        *o++ = Hex[*p & 0xf];
     }
-    printf("\n");
+    *o++ = '\n';
+    t->leng = o - t->buf;
 }
 
-static char *
-mknote(int pitch) {
+#ifndef MFCHECK
+/* fill in Notenames for -n */
+static void
+mknotes(void) {
     static char *Notes[] =
         { "c", "c#", "d", "d#", "e", "f", "f#", "g",
           "g#", "a", "a#", "b" };
-    static char buf[20];
+    int pitch;
+
+    for (pitch = 0; pitch < 256; pitch++)
+        snprintf(Notenames[pitch], sizeof(Notenames[pitch]), "%s%d",
+                Notes[pitch % 12], pitch/12);
+}
+#endif
+
+static void
+prnote(struct mf2t *t, int pitch) {
     if (notes)
-        sprintf(buf, "%s%d", Notes[pitch % 12], pitch/12);
+        outs(t, Notenames[pitch & 0xff]);
     else
-        sprintf(buf, "%d", pitch);
-    return buf;
+        outd(t, pitch);
+}
+
+/* a channel message with a note: msg[0] chan msg[1] note msg[2] val */
+static void
+prnotemsg(struct mf_reader *r, const char **msg, int chan, int pitch,
+        int val) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, msg[0]);
+    outd(t, chan+1);
+    outs(t, msg[1]);
+    prnote(t, pitch);
+    outs(t, msg[2]);
+    outd(t, val);
+    outc(t, '\n');
+}
+
+/* any other: msg[0] chan msg[1] val [msg[2] val2] */
+static void
+prchanmsg(struct mf_reader *r, const char **msg, int nvals, int chan,
+        int val, int val2) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, msg[0]);
+    outd(t, chan+1);
+    outs(t, msg[1]);
+    outd(t, val);
+    if (nvals > 1) {
+        outs(t, msg[2]);
+        outd(t, val2);
+    }
+    outc(t, '\n');
+}
+
+/* a file that can’t be converted: say why, and exit unless batch */
+static void
+cant(struct mf2t *t, const char *fmt, int n) {
+    flush(t);
+    if (t->name)
+        fprintf(stderr, "%s: ", t->name);
+    fprintf(stderr, fmt, n);
+    if (!batch)
+        exit (1);
+    t->failed = 1;
 }
 
 static void
-myheader(int format, int ntrks, int division) {
+myheader(struct mf_reader *r, int format, int ntrks, int division) {
+    struct mf2t *t = r->data;
+
+    outs(t, "MFile ");
+    outd(t, format);
+    outc(t, ' ');
+    outd(t, ntrks);
+    outc(t, ' ');
     if (division & 0x8000) { /* SMPTE */
-        times = 0; /* Can’t do beats */
-        printf("MFile %d %d %d %d\n",format,ntrks,
-                -((-(division>>8))&0xff), division&0xff);
+        t->times = 0; /* Can’t do beats */
+        outd(t, -((-(division>>8))&0xff));
+        outc(t, ' ');
+        outd(t, division&0xff);
     } else
-        printf("MFile %d %d %d\n",format,ntrks,division);
-    if (format > 2) {
-        fprintf(stderr, "Can’t deal with format %d files\n", format);
-        exit (1);
+        outd(t, division);
+    outc(t, '\n');
+    if (format > 2)
+        cant(t, "Can’t deal with format %d files\n", format);
+    else if (t->map) {
+        mf_tempo_map_free(t->map);
+        if (mf_tempo_map_init(t->map, division) < 0)
+            cant(t, "Can’t give times with division %d\n", division);
     }
-    Beat = Clicks = division;
-    TrksToDo = ntrks;
+    t->format = format;
+    t->beat = t->clicks = division;
+    t->trkstodo = ntrks;
 }
 
 static void
-mytrstart(void) {
-    printf("MTrk\n");
-    TrkNr ++;
+mytrstart(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+
+    if (t->st) {
+        t->trkstart = stats_now();
+        t->trkevents = r->stats->events;
+        t->trktext = t->written + t->leng;
+    }
+    /* format 2 tracks are each a sequence of their own */
+    if (t->map && t->format == 2 && t->trknr > 0 && !t->merging) {
+        mf_tempo_map_free(t->map);
+        if (mf_tempo_map_init(t->map, t->clicks) < 0) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+    }
+    t->seg = 0;
+    if (!t->merging)
+        outs(t, "MTrk\n");
+    t->trknr ++;
 }
 
 static void
-mytrend(void) {
-    printf("TrkEnd\n");
-    --TrksToDo;
+mytrend(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+    struct trkstats *ts;
+
+    if (!t->merging)
+        outs(t, "TrkEnd\n");
+    --t->trkstodo;
+    if (t->st && (ts = stats_track(t->st, t->trknr - 1)) != NULL) {
+        ts->events = r->stats->events - t->trkevents;
+        ts->bytes = t->written + t->leng - t->trktext;
+        ts->secs = stats_now() - t->trkstart;
+    }
 }
 
 static void
-mynon(int chan, int pitch, int vol) {	/* note on */
-    prtime();
-    printf(Onmsg, chan+1, mknote(pitch), vol);
+mynon(struct mf_reader *r, int chan, int pitch, int vol) {	/* note on */
+    prnotemsg(r, Onmsg, chan, pitch, vol);
 }
 
 static void
-mynoff(int chan, int pitch, int vol) {	/* note off */
-    prtime();
-    printf(Offmsg, chan+1, mknote(pitch), vol);
+mynoff(struct mf_reader *r, int chan, int pitch, int vol) {	/* note off */
+    prnotemsg(r, Offmsg, chan, pitch, vol);
 }
 
 static void
-mypressure(int chan, int pitch, int press) {
-    prtime();
-    printf(PoPrmsg, chan+1, mknote(pitch), press);
+mypressure(struct mf_reader *r, int chan, int pitch, int press) {
+    prnotemsg(r, PoPrmsg, chan, pitch, press);
 }
 
 static void
-myparameter(int chan, int control, int value) {
-    prtime();
-    printf(Parmsg, chan+1, control, value);
+myparameter(struct mf_reader *r, int chan, int control, int value) {
+    prchanmsg(r, Parmsg, 2, chan, control, value);
 }
 
 static void
-mypitchbend(int chan, int lsb, int msb) {
-    prtime();
-    printf(Pbmsg, chan+1, 128*msb+lsb);
+mypitchbend(struct mf_reader *r, int chan, int lsb, int msb) {
+    prchanmsg(r, Pbmsg, 1, chan, 128*msb+lsb, 0);
 }
 
 static void
-myprogram(int chan, int program) {
-    prtime();
-    printf(PrChmsg, chan+1, program);
+myprogram(struct mf_reader *r, int chan, int program) {
+    prchanmsg(r, PrChmsg, 1, chan, program, 0);
 }
 
 static void
-mychanpressure(int chan, int press) {
-    prtime();
-    printf(ChPrmsg, chan+1, press);
+mychanpressure(struct mf_reader *r, int chan, int press) {
+    prchanmsg(r, ChPrmsg, 1, chan, press, 0);
 }
 
 static void
-mysysex(int leng, char *mess) {
-    prtime();
-    printf("SysEx");
-    prhex((unsigned char *)mess, leng);
+mysysex(struct mf_reader *r, int leng, char *mess) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "SysEx");
+    prhex(t, (unsigned char *)mess, leng);
 }
 
 static void
-mymmisc(int type, int leng, char *mess) {
-    prtime();
-    printf("Meta 0x%02x",type);
-    prhex((unsigned char *)mess, leng);
+mymmisc(struct mf_reader *r, int type, int leng, char *mess) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "Meta 0x");
+    outx(t, type);
+    prhex(t, (unsigned char *)mess, leng);
 }
 
 static void
-mymspecial(int leng, char *mess) {
-    prtime();
-    printf("SeqSpec");
-    prhex((unsigned char *)mess, leng);
+mymspecial(struct mf_reader *r, int leng, char *mess) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "SeqSpec");
+    prhex(t, (unsigned char *)mess, leng);
 }
 
 static void
-mymtext(int type, int leng, char *mess) {
+mymtext(struct mf_reader *r, int type, int leng, char *mess) {
     static char *ttype[] = {
         NULL,
         "Text",         /* type=0x01 */
@@ -238,117 +560,827 @@ mymtext(int type, int leng, char *mess) {
         "Unrec"
     };
     int unrecognized = (sizeof(ttype)/sizeof(char *)) - 1;
+    struct mf2t *t = r->data;
 
-    prtime();
-    if (type < 1 || type > unrecognized)
-        printf("Meta 0x%02x ",type);
-    else if (type == 3 && TrkNr == 1)
-        printf("Meta SeqName ");
-    else
-        printf("Meta %s ",ttype[type]);
-    prtext((unsigned char *)mess, leng);
+    prtime(r);
+    if (type < 1 || type > unrecognized) {
+        outs(t, "Meta 0x");
+        outx(t, type);
+        outc(t, ' ');
+    } else if (type == 3 && t->trknr == 1)
+        outs(t, "Meta SeqName ");
+    else {
+        outs(t, "Meta ");
+        outs(t, ttype[type]);
+        outc(t, ' ');
+    }
+    prtext(t, (unsigned char *)mess, leng);
 }
 
 static void
-mymseq(int num) {
-    prtime();
-    printf("SeqNr %d\n",num);
+mymseq(struct mf_reader *r, int num) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "SeqNr ");
+    outd(t, num);
+    outc(t, '\n');
 }
 
 static void
-mymeot(void) {
-    prtime();
-    printf("Meta TrkEnd\n");
+mymeot(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "Meta TrkEnd\n");
 }
 
 static void
-mykeysig(int sf, int mi) {
-    prtime();
-    printf("KeySig %d %s\n", (sf>127?sf-256:sf), (mi?"minor":"major"));
+mykeysig(struct mf_reader *r, int sf, int mi) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "KeySig ");
+    outd(t, (sf>127?sf-256:sf));
+    outs(t, (mi?" minor\n":" major\n"));
 }
 
 static void
-mytempo(mf_tempo_t tempo) {
-    prtime();
-    printf("Tempo %d\n",tempo);
+mytempo(struct mf_reader *r, mf_tempo_t tempo) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "Tempo ");
+    outd(t, tempo);
+    outc(t, '\n');
+    if (t->map && !t->premapped &&
+            mf_tempo_map_add(t->map, r->currtime, tempo) < 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
 }
 
 static void
-mytimesig(int nn, int dd, int cc, int bb) {
+mytimesig(struct mf_reader *r, int nn, int dd, int cc, int bb) {
+    struct mf2t *t = r->data;
     int denom = 1;
     while (dd-- > 0)
         denom *= 2;
-    prtime();
-    printf("TimeSig %d/%d %d %d\n", nn,denom,cc,bb);
-    M0 += (Mf_currtime-T0)/(Beat*Measure);
-    T0 = Mf_currtime;
-    Measure = nn;
-    Beat = 4 * Clicks / denom;
+    prtime(r);
+    outs(t, "TimeSig ");
+    outd(t, nn);
+    outc(t, '/');
+    outd(t, denom);
+    outc(t, ' ');
+    outd(t, cc);
+    outc(t, ' ');
+    outd(t, bb);
+    outc(t, '\n');
+    t->m0 += (r->currtime-t->t0)/(t->beat*t->measure);
+    t->t0 = r->currtime;
+    t->measure = nn;
+    t->beat = 4 * t->clicks / denom;
+}
+
+static void
+mysmpte(struct mf_reader *r, int hr, int mn, int se, int fr, int ff) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "SMPTE ");
+    outd(t, hr);
+    outc(t, ' ');
+    outd(t, mn);
+    outc(t, ' ');
+    outd(t, se);
+    outc(t, ' ');
+    outd(t, fr);
+    outc(t, ' ');
+    outd(t, ff);
+    outc(t, '\n');
+}
+
+static void
+myarbitrary(struct mf_reader *r, int leng, char *mess) {
+    struct mf2t *t = r->data;
+
+    prtime(r);
+    outs(t, "Arb");
+    prhex (t, (unsigned char *)mess, leng);
+}
+
+static int
+mygetc(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+
+    return getc(t->in);
+}
+
+static void
+initfuncs(struct mf_reader *r) {
+    mf_reader_init(r);
+    r->Mf_rerror = error;
+    r->Mf_getc = mygetc;
+    r->Mf_header =  myheader;
+    r->Mf_starttrack =  mytrstart;
+    r->Mf_endtrack =  mytrend;
+    r->Mf_on =  mynon;
+    r->Mf_off =  mynoff;
+    r->Mf_pressure =  mypressure;
+    r->Mf_parameter =  myparameter;
+    r->Mf_pitchbend =  mypitchbend;
+    r->Mf_program =  myprogram;
+    r->Mf_chanpressure =  mychanpressure;
+    r->Mf_sysex =  mysysex;
+    r->Mf_metamisc =  mymmisc;
+    r->Mf_seqnum =  mymseq;
+    r->Mf_eot =  mymeot;
+    r->Mf_timesig =  mytimesig;
+    r->Mf_smpte =  mysmpte;
+    r->Mf_tempo =  mytempo;
+    r->Mf_keysig =  mykeysig;
+    r->Mf_sqspecific =  mymspecial;
+    r->Mf_text =  mymtext;
+    r->Mf_arbitrary =  myarbitrary;
+    r->nomerge = nomerge;
+}
+
+#if _POSIX_C_SOURCE >= 2
+/*
+ * Parallel decoding (see partrack.h).  The track chunks are found by
+ * hopping over their lengths, and each is decoded into a buffer of
+ * its own, which is written out in track order.  A track can’t be
+ * done cleanly if it has an error or an event running past the end of
+ * its chunk.  With -S, Counts[i] is what track i’s reader counted.
+ */
+
+struct track {
+    const mf_data_t *chunk;	/* the MTrk chunk, header included */
+    mf_size_t len;		/* and its length */
+    char *text;			/* the text for it */
+    size_t leng;
+};
+
+/* a worker’s reader, kept from one track to the next */
+struct trackreader {
+    struct mf_reader r;
+    struct mf2t t;
+};
+
+static struct track *Tracks;
+static struct mf2t Start;	/* state before the first track */
+static struct mf_stats *Counts;	/* -S: for each track */
+
+/* decode track i into its buffer; 0 if that can’t be done cleanly */
+static int
+dotrack(void **state, int i) {
+    struct trackreader *tr = *state;
+    struct track *trk = &Tracks[i];
+
+    if (tr == NULL) {
+        if ((tr = *state = malloc(sizeof(*tr))) == NULL)
+            return(0);
+        initfuncs(&tr->r);
+        tr->r.Mf_rerror = NULL;	/* errors are left for the main thread */
+        tr->r.noexit = 1;
+        tr->r.data = &tr->t;
+    }
+    tr->t = Start;
+    tr->t.trknr += i;
+    tr->t.out = NULL;
+    tr->t.buf = NULL;
+    tr->t.leng = tr->t.size = 0;
+    tr->t.counts = tr->r.stats = Counts ? &Counts[i] : NULL;
+    if (mfread_track_buf_r(&tr->r, trk->chunk, trk->len) != trk->len ||
+            tr->t.failed) {
+        free(tr->t.buf);
+        return(0);
+    }
+    trk->text = tr->t.buf;
+    trk->leng = tr->t.leng;
+    return(1);
+}
+
+static void
+freetrackreader(void *state) {
+    struct trackreader *tr = state;
+
+    mf_reader_free(&tr->r);
+    free(tr);
+}
+
+/*
+ * Decode as many of the tracks at buf as can be done in parallel and
+ * write them out; return the number of bytes dealt with.
+ */
+static mf_size_t
+partracks(struct mf_reader *r, const mf_data_t *buf, mf_size_t len) {
+    struct mf2t *t = r->data;
+    const mf_data_t *p, *end = buf + len;
+    struct track *more;
+    mf_size_t done = 0;
+    uint32_t clen;
+    int i, ntracks = 0;
+
+    Tracks = NULL;
+    for (p = buf; end - p >= 8 && memcmp(p, "MTrk", 4) == 0; p += clen) {
+        clen = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+        if (clen & 0x80000000 || clen > (mf_size_t)(end - p) - 8)
+            break;
+        clen += 8;
+        if ((ntracks & (ntracks - 1)) == 0) {
+            more = realloc(Tracks, (ntracks ? 2*ntracks : 1) * sizeof(*more));
+            if (more == NULL)
+                break;
+            Tracks = more;
+        }
+        Tracks[ntracks].chunk = p;
+        Tracks[ntracks].len = clen;
+        Tracks[ntracks].text = NULL;
+        ntracks++;
+    }
+
+    /* workers fill in the counts for their tracks, but can’t make room */
+    Counts = NULL;
+    if (t->st && ntracks > 0 &&
+            (stats_track(t->st, t->trknr + ntracks - 1) == NULL ||
+            (Counts = calloc(ntracks, sizeof(*Counts))) == NULL)) {
+        free(Tracks);
+        return(0);
+    }
+    Start = *t;
+    if (partrack_run(ntracks, jobs, dotrack, freetrackreader) < 0) {
+        free(Counts);
+        free(Tracks);
+        return(0);
+    }
+
+    for (i = 0; i < ntracks && partrack_wait(i); i++) {
+        flush(t);
+        output(t, Tracks[i].text, Tracks[i].leng);
+        if (Counts)
+            mf_stats_add(&t->st->lib, &Counts[i]);
+        free(Tracks[i].text);
+        Tracks[i].text = NULL;
+        t->trknr++;
+        t->trkstodo--;
+        done += Tracks[i].len;
+    }
+
+    partrack_end();
+    for (i = 0; i < ntracks; i++)
+        free(Tracks[i].text);
+    free(Tracks);
+    free(Counts);
+    return(done);
+}
+#endif
+
+/*
+ * Merging (-M).  Each track has a reader of its own, which is fed the
+ * track a slice at a time whenever the events it has queued have all
+ * been written out, so only a slice of each track is decoded at once.
+ * A heap holds the tracks with events queued, by the time of the
+ * first and then by track, and the first event of the one on top is
+ * written out with its track number after the time.
+ */
+
+#define SLICE 256		/* bytes of a track decoded at a time */
+#define SLICETEXT (16*SLICE)	/* about the most text they make */
+
+struct cursor {
+    struct mf_reader r;
+    struct mf2t t;		/* the events queued */
+    const mf_data_t *p, *end;	/* the part of the track still to decode */
+    struct mf_stats counts;	/* -S */
+};
+
+/*
+ * Decode c’s track until an event is queued or it ends; -1 on error,
+ * after which the events queued before it are still there but the
+ * rest of the track is given up.
+ */
+static int
+refill(struct cursor *c) {
+    struct mf2t *q = &c->t;
+    mf_size_t n;
+
+    q->written += q->leng;
+    q->leng = 0;
+    q->nqueued = q->next = 0;
+    while (q->nqueued == 0 && c->p < c->end) {
+        n = c->end - c->p < SLICE ? c->end - c->p : SLICE;
+        c->p += n;
+        if (mfread_feed_tracks_r(&c->r, c->p - n, n) < 0 ||
+                (c->p == c->end && mfread_finish_r(&c->r) < 0)) {
+            c->p = c->end;
+            return(-1);
+        }
+    }
+    return(0);
+}
+
+/* 1 if the next event of cursor a comes before that of b */
+static int
+before(const struct cursor *c, int a, int b) {
+    mf_deltat_t ta = c[a].t.queue[c[a].t.next].time;
+    mf_deltat_t tb = c[b].t.queue[c[b].t.next].time;
+
+    return(ta < tb || (ta == tb && a < b));
+}
+
+/* move heap[i] down to where it belongs among the n */
+static void
+siftdown(const struct cursor *c, int *heap, int n, int i) {
+    int k, top = heap[i];
+
+    while ((k = 2 * i + 1) < n) {
+        if (k + 1 < n && before(c, heap[k + 1], heap[k]))
+            k++;
+        if (!before(c, heap[k], top))
+            break;
+        heap[i] = heap[k];
+        i = k;
+    }
+    heap[i] = top;
+}
+
+/* write out the next event of track i, whose cursor is c */
+static void
+emit(struct mf2t *t, struct cursor *c, int i) {
+    struct mf2t *q = &c->t;
+    struct queued *e = &q->queue[q->next++];
+    size_t end = q->next < q->nqueued ? q->queue[q->next].start : q->leng;
+
+    outtime(t, e->time);
+    outs(t, "track=");
+    outd(t, t->trknr + i + 1);
+    outc(t, ' ');
+    memcpy(room(t, end - e->start), q->buf + e->start, end - e->start);
+    t->leng += end - e->start;
+}
+
+/*
+ * Decode the tracks at buf side by side and write their events out in
+ * time order; -1 if that failed.  Anything after the last whole track
+ * chunk is left to the last reader, to complain about as usual.  The
+ * events of the other tracks, and those before an error, are still
+ * written out.
+ */
+static int
+mergetracks(struct mf_reader *r, const mf_data_t *buf, mf_size_t len) {
+    struct mf2t *t = r->data;
+    const mf_data_t *p, *end = buf + len;
+    struct cursor *c = NULL, *more;
+    int *heap, ntracks = 0, nheap = 0, i, status = 0;
+    uint32_t clen;
+
+    for (p = buf; p < end; p += clen) {
+        clen = end - p;
+        if (end - p >= 8 && memcmp(p, "MTrk", 4) == 0) {
+            clen = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+            if (clen & 0x80000000 || clen > (mf_size_t)(end - p) - 8)
+                clen = end - p;
+            else
+                clen += 8;
+        }
+        if ((ntracks & (ntracks - 1)) == 0) {
+            more = realloc(c, (ntracks ? 2*ntracks : 1) * sizeof(*more));
+            if (more == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+            c = more;
+        }
+        c[ntracks].p = p;
+        c[ntracks].end = p + clen;
+        ntracks++;
+    }
+    if (ntracks == 0)
+        return(0);
+    if ((heap = malloc(ntracks * sizeof(*heap))) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < ntracks; i++) {
+        initfuncs(&c[i].r);
+        c[i].r.noexit = 1;
+        c[i].r.data = &c[i].t;
+        c[i].r.track = r->track + i;
+        c[i].r.offset = r->offset + (c[i].p - buf);
+        memset(&c[i].counts, 0, sizeof(c[i].counts));
+        c[i].t = *t;
+        c[i].t.out = NULL;
+        if ((c[i].t.buf = malloc(SLICETEXT)) == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        c[i].t.size = SLICETEXT;
+        c[i].t.leng = c[i].t.written = 0;
+        c[i].t.merging = 1;
+        c[i].t.queue = NULL;
+        c[i].t.maxqueued = 0;
+        c[i].t.trknr += i;
+        c[i].t.trkstodo -= i;
+        c[i].t.counts = c[i].r.stats = t->st ? &c[i].counts : NULL;
+    }
+    for (i = 0; i < ntracks; i++) {
+        if (refill(&c[i]) < 0)
+            status = -1;
+        if (c[i].t.nqueued > 0)
+            heap[nheap++] = i;
+    }
+    for (i = nheap / 2 - 1; i >= 0; i--)
+        siftdown(c, heap, nheap, i);
+
+    while (nheap > 0) {
+        i = heap[0];
+        emit(t, &c[i], i);
+        if (c[i].t.next == c[i].t.nqueued) {
+            if (refill(&c[i]) < 0)
+                status = -1;
+            if (c[i].t.nqueued == 0)
+                heap[0] = heap[--nheap];
+        }
+        siftdown(c, heap, nheap, 0);
+    }
+
+    for (i = 0; i < ntracks; i++) {
+        if (t->st)
+            mf_stats_add(&t->st->lib, &c[i].counts);
+        free(c[i].t.buf);
+        free(c[i].t.queue);
+        mf_reader_free(&c[i].r);
+    }
+    t->trknr += ntracks;
+    t->trkstodo -= ntracks;
+    free(heap);
+    free(c);
+    if (status < 0) {
+        flush(t);
+        if (!batch)
+            exit(1);
+    }
+    return(status);
+}
+
+/* the Tempo finder’s Mf_tempo */
+static void
+addtempo(struct mf_reader *r, mf_tempo_t tempo) {
+    if (mf_tempo_map_add(r->data, r->currtime, tempo) < 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+}
+
+/*
+ * -u, -s: put the Tempos of all the tracks at buf in t->map before any
+ * track is written, as in format 1 those of one track count for all.
+ * Only the Tempos are looked at; a track with an error is left for the
+ * real decoding to complain about.
+ */
+static void
+findtempos(struct mf2t *t, const mf_data_t *buf, mf_size_t len) {
+    struct mf_reader r;
+    mf_size_t n = 0, trk;
+
+    mf_reader_init(&r);
+    r.noexit = 1;
+    r.data = t->map;
+    r.Mf_tempo = addtempo;
+    while ((trk = mfread_track_buf_r(&r, buf + n, len - n)) > 0)
+        n += trk;
+    mf_reader_free(&r);
+    t->premapped = 1;
+}
+
+/* decode the len bytes of MIDI file at buf; -1 if that failed */
+static int
+readbuf(struct mf_reader *r, const mf_data_t *buf, mf_size_t len) {
+    struct mf2t *t = r->data;
+    mf_size_t n, trk;
+
+    n = mfread_header_buf_r(r, buf, len);
+    if (r->err.reason[0] || t->failed)
+        return(-1);
+    /* in format 2 each track has Tempos of its own, unless merged */
+    if (t->map && (t->format != 2 || merge))
+        findtempos(t, buf + n, len - n);
+    if (merge)
+        return(mergetracks(r, buf + n, len - n));
+#if _POSIX_C_SOURCE >= 2
+    /* bar:beat:click needs earlier tracks; batch mode has a thread a file */
+    if (jobs > 1 && !t->times && !batch && (!t->map || t->premapped))
+        n += partracks(r, buf + n, len - n);
+#endif
+    while ((trk = mfread_track_buf_r(r, buf + n, len - n)) > 0)
+        n += trk;
+    return(r->err.reason[0] ? -1 : 0);
+}
+
+#ifndef MFCHECK
+/* read up to n bytes of t->in */
+static size_t
+input(struct mf2t *t, mf_data_t *buf, size_t n) {
+    double start = t->st ? stats_now() : 0;
+
+    n = fread(buf, 1, n, t->in);
+    if (t->st)
+        t->st->read += stats_now() - start;
+    return(n);
+}
+
+/* read all of t->in into memory and decode it there, for -M */
+static int
+readall(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+    mf_data_t *buf = NULL, *more;
+    size_t len = 0, size = 0, n;
+    int status;
+
+    do {
+        if (len == size) {
+            size = size ? 2 * size : BLOCKSIZE;
+            if ((more = realloc(buf, size)) == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+            buf = more;
+        }
+        len += n = input(t, buf + len, size - len);
+    } while (n > 0);
+    status = readbuf(r, buf, len);
+    free(buf);
+    return(status);
+}
+
+/*
+ * Map a regular file t->in (or failing that, read it into memory) and
+ * decode it from there; anything else (pipes, terminals) is decoded a
+ * block at a time as it arrives, or with -M, -u or -s read in whole
+ * first.  Returns -1 if that failed.
+ */
+static int
+readinput(struct mf_reader *r) {
+    struct mf2t *t = r->data;
+    struct stat st;
+    mf_data_t *buf;
+    off_t off;
+    size_t len;
+    int status;
+#if _POSIX_C_SOURCE >= 2
+    double start;
+#endif
+
+    if (fstat(fileno(t->in), &st) < 0 || !S_ISREG(st.st_mode) ||
+            (off = ftello(t->in)) < 0 || st.st_size <= off) {
+        if (merge || t->map)
+            return(readall(r));
+        /* a pipe: decode each block as it comes */
+        if ((buf = malloc(BLOCKSIZE)) == NULL)
+            return(mfread_r(r));
+        while (!t->failed && (len = input(t, buf, BLOCKSIZE)) > 0)
+            if (mfread_feed_r(r, buf, len) < 0)
+                break;
+        status = mfread_finish_r(r);
+        free(buf);
+        return(t->failed ? -1 : status);
+    }
+#if _POSIX_C_SOURCE >= 2
+    start = t->st ? stats_now() : 0;
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(t->in), 0);
+    if (t->st)
+        t->st->read += stats_now() - start;
+    if (buf != MAP_FAILED) {
+        status = readbuf(r, buf + off, st.st_size - off);
+        munmap(buf, st.st_size);
+        return(status);
+    }
+#endif
+    if ((buf = malloc(st.st_size - off)) == NULL)
+        return(merge || t->map ? readall(r) : mfread_r(r));
+    len = input(t, buf, st.st_size - off);
+    status = readbuf(r, buf, len);
+    free(buf);
+    return(status);
 }
 
+/* start counting for -S in st */
 static void
-mysmpte(int hr, int mn, int se, int fr, int ff) {
-    prtime();
-    printf("SMPTE %d %d %d %d %d\n", hr, mn, se, fr, ff);
+newstats(struct mf_reader *r, struct stats *st) {
+    struct mf2t *t = r->data;
+
+    stats_begin(st);
+    t->st = st;
+    t->counts = r->stats = &st->lib;
 }
 
+/* write what -S counted for the file name; decoding includes the text */
 static void
-myarbitrary(int leng, char *mess) {
-    prtime();
-    printf("Arb");
-    prhex ((unsigned char *)mess, leng);
+report(struct mf2t *t, const char *name, int status) {
+    stats_report(Statsfp, name, t->st, "decode", t->st->lib.bytes,
+            t->written, status);
 }
+#endif
 
+/* get t ready for a new file, keeping its buffer */
 static void
-initfuncs(void) {
-    Mf_rerror = error;
-    Mf_getc = getchar;
-    Mf_header =  myheader;
-    Mf_starttrack =  mytrstart;
-    Mf_endtrack =  mytrend;
-    Mf_on =  mynon;
-    Mf_off =  mynoff;
-    Mf_pressure =  mypressure;
-    Mf_parameter =  myparameter;
-    Mf_pitchbend =  mypitchbend;
-    Mf_program =  myprogram;
-    Mf_chanpressure =  mychanpressure;
-    Mf_sysex =  mysysex;
-    Mf_metamisc =  mymmisc;
-    Mf_seqnum =  mymseq;
-    Mf_eot =  mymeot;
-    Mf_timesig =  mytimesig;
-    Mf_smpte =  mysmpte;
-    Mf_tempo =  mytempo;
-    Mf_keysig =  mykeysig;
-    Mf_sqspecific =  mymspecial;
-    Mf_text =  mymtext;
-    Mf_arbitrary =  myarbitrary;
+newfile(struct mf2t *t, FILE *in, FILE *out) {
+    t->in = in;
+    t->out = out;
+    t->leng = 0;
+    t->written = 0;
+    t->failed = 0;
+    t->times = times;
+    t->trknr = 0;
+    t->trkstodo = 1;
+    t->measure = 4;
+    t->beat = 96;
+    t->clicks = 96;
+    t->t0 = 0;
+    t->m0 = 0;
+    t->format = 0;
+    t->seg = 0;
+    t->premapped = 0;
+}
+
+#ifdef MFCHECK
+char *
+mf2t_text(const char *name, const mf_data_t *buf, mf_size_t len,
+        int nomerge, size_t *lengp) {
+    struct mf_reader r;
+    struct mf2t t;
+    int status;
+
+    initfuncs(&r);
+    r.nomerge = nomerge;
+    r.noexit = 1;
+    r.data = &t;
+    memset(&t, 0, sizeof(t));
+    newfile(&t, NULL, NULL);	/* keep all the text in t.buf */
+    t.name = name;
+    status = readbuf(&r, buf, len);
+    mf_reader_free(&r);
+    if (status < 0) {
+        free(t.buf);
+        return(NULL);
+    }
+    *lengp = t.leng;
+    return(t.buf);
+}
+#else
+
+/*
+ * Batch mode.  The files named on the command line (all the .mid
+ * files, for a directory) and in a list file are each converted to a
+ * .txt file of the same name, next to it or in outdir.  Worker threads
+ * each take a file at a time, keeping their reader and text buffer
+ * from one to the next.  A file that can’t be converted is reported,
+ * and the rest are still done.
+ */
+
+/* the .txt file for name */
+static char *
+txtname(const char *name) {
+    const char *base = name, *p, *dot = NULL;
+    size_t dirleng = 0;
+    char *txt;
+
+    for (p = name; *p; p++)
+        if (*p == '/')
+            base = p + 1, dot = NULL;
+        else if (*p == '.')
+            dot = p;
+    if (dot == NULL || dot == base)
+        dot = p;
+    if (outdir) {
+        dirleng = strlen(outdir) + 1;
+        name = base;
+    }
+    if ((txt = malloc(dirleng + (dot - name) + 5)) == NULL)
+        return(NULL);
+    if (outdir)
+        sprintf(txt, "%s/", outdir);
+    sprintf(txt + dirleng, "%.*s.txt", (int)(dot - name), name);
+    return(txt);
+}
+
+/* convert one file; -1 if that failed */
+static int
+convert(struct mf_reader *r, const char *name) {
+    struct mf2t *t = r->data;
+    char *txt;
+    FILE *in, *out;
+    int status;
+
+    if ((txt = txtname(name)) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return(-1);
+    }
+    if (strcmp(txt, name) == 0) {
+        fprintf(stderr, "%s: would be overwritten\n", name);
+        free(txt);
+        return(-1);
+    }
+    if ((in = fopen(name, "rb")) == NULL) {
+        perror(name);
+        free(txt);
+        return(-1);
+    }
+    if ((out = fopen(txt, "w")) == NULL) {
+        perror(txt);
+        fclose(in);
+        free(txt);
+        return(-1);
+    }
+    newfile(t, in, out);
+    t->name = name;
+    status = readinput(r);
+    flush(t);
+    if (ferror(out) | (fclose(out) != 0)) {
+        perror(txt);
+        status = -1;
+    }
+    if (t->st)
+        report(t, name, status);
+    fclose(in);
+    free(txt);
+    return(status);
+}
+
+/* convert files until there are none left, counting failures in *arg */
+static void *
+batchworker(void *arg) {
+    int *failures = arg;
+    struct mf_reader r;
+    struct mf2t t;
+    struct stats st;
+    struct mf_tempo_map map;
+    const char *name;
+
+    initfuncs(&r);
+    r.noexit = 1;
+    r.data = &t;
+    memset(&t, 0, sizeof(t));
+    memset(&st, 0, sizeof(st));
+    memset(&map, 0, sizeof(map));
+    if (realtime)
+        t.map = &map;
+    while ((name = batch_next()) != NULL) {
+        if (Statsfp)
+            newstats(&r, &st);
+        if (convert(&r, name) < 0)
+            ++*failures;
+    }
+    free(t.buf);
+    stats_free(&st);
+    mf_tempo_map_free(&map);
+    mf_reader_free(&r);
+    return(NULL);
 }
 
 static void
 usage(void) {
     fprintf(stderr,
 "mf2t v%s\n"
-"Usage: mf2t [-mnbtv] [-f n] [midifile [textfile]]\n\n"
+"Usage: mf2t [-mnbtusMv] [-f n] [-j n] [-S file] [midifile [textfile]]\n"
+"       mf2t -B [-d dir] [-l list] [-mnbtusMv] [-f n] [-j n] [-S file]\n"
+"               [file|dir...]\n\n"
 "Options:\n"
 "  -m      merge partial sysex into a single sysex message\n"
 "  -n      write notes in symbolic form\n"
 "  -b|-t   write event times as bar:beat:click\n"
+"  -u      write event times in microseconds from the start\n"
+"  -s      write event times in seconds from the start\n"
+"  -M      merge the tracks into one, in time order, with track=n\n"
 "  -v      use slightly more verbose output\n"
-"  -f n    fold long text and hex entries at n characters\n", VERSION);
+"  -f n    fold long text and hex entries at n characters\n"
+"  -j n    decode up to n tracks (files) at once (default: one per CPU)\n"
+"  -B      batch mode: write each midifile’s text to a .txt file\n"
+"  -d dir  put the .txt files in dir (implies -B)\n"
+"  -l list also convert the files named in list, one per line (-B)\n"
+"  -S file write statistics for each midifile to file (- for stderr)\n",
+	VERSION);
     exit(1);
 }
 
 int
 main(int argc, char **argv) {
-    int c;
+    struct mf_reader r;
+    struct mf2t t;
+    struct stats st;
+    struct mf_tempo_map map;
+    const char *list = NULL, *name = "-";
+    int c, status;
 
-    Mf_nomerge = 1;
-    while ((c = getopt(argc, argv, "mnbtvf:h")) != -1) {
+#if _POSIX_C_SOURCE >= 2 && defined(_SC_NPROCESSORS_ONLN)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    while ((c = getopt(argc, argv, "mnbtusMvf:j:Bd:l:S:h")) != -1) {
         switch (c) {
 	case 'm':
-	    Mf_nomerge = 0;
+	    nomerge = 0;
 	    break;
 	case 'n':
 	    notes++;
@@ -357,18 +1389,54 @@ main(int argc, char **argv) {
 	case 't':
 	    times++;
 	    break;
+	case 'u':
+	    realtime = 1;
+	    break;
+	case 's':
+	    realtime = 2;
+	    break;
+	case 'M':
+	    merge = 1;
+	    break;
 	case 'v':
-	    Onmsg  = "On ch=%d note=%s vol=%d\n";
-	    Offmsg = "Off ch=%d note=%s vol=%d\n";
-	    PoPrmsg = "PolyPr ch=%d note=%s val=%d\n";
-	    Parmsg = "Param ch=%d con=%d val=%d\n";
-	    Pbmsg  = "Pb ch=%d val=%d\n";
-	    PrChmsg = "ProgCh ch=%d prog=%d\n";
-	    ChPrmsg = "ChanPr ch=%d val=%d\n";
+	    Onmsg[1] = Offmsg[1] = PoPrmsg[1] = " note=";
+	    Onmsg[2] = Offmsg[2] = " vol=";
+	    PoPrmsg[0] = "PolyPr ch=";
+	    PoPrmsg[2] = " val=";
+	    Parmsg[0] = "Param ch=";
+	    Parmsg[1] = " con=";
+	    Parmsg[2] = " val=";
+	    Pbmsg[1] = " val=";
+	    PrChmsg[0] = "ProgCh ch=";
+	    PrChmsg[1] = " prog=";
+	    ChPrmsg[0] = "ChanPr ch=";
+	    ChPrmsg[1] = " val=";
 	    break;
 	case 'f':
 	    fold = atoi(optarg);
 	    break;
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 'B':
+	    batch = 1;
+	    break;
+	case 'd':
+	    outdir = optarg;
+	    batch = 1;
+	    break;
+	case 'l':
+	    list = optarg;
+	    batch = 1;
+	    break;
+	case 'S':
+	    if (strcmp(optarg, "-") == 0)
+		Statsfp = stderr;
+	    else if ((Statsfp = fopen(optarg, "w")) == NULL) {
+		perror(optarg);
+		exit(1);
+	    }
+	    break;
 	case 'h':
 	case '?':
 	default:
@@ -376,7 +1444,18 @@ main(int argc, char **argv) {
         }
     }
 
-    if (optind < argc && !freopen(argv[optind++], "rb", stdin)) {
+    mknotes();
+    if (realtime || merge)
+        times = 0;
+    if (batch) {
+        if (list)
+            batch_addlist(list, batch_ismidi);
+        while (optind < argc)
+            batch_addarg(argv[optind++], batch_ismidi);
+        return(batch_run(jobs, batchworker) ? 1 : 0);
+    }
+
+    if (optind < argc && !freopen(name = argv[optind++], "rb", stdin)) {
 	perror(argv[optind - 1]);
         exit(1);
     }
@@ -386,14 +1465,22 @@ main(int argc, char **argv) {
         exit(1);
     }
 
-    initfuncs();
-    TrkNr = 0;
-    Measure = 4;
-    Beat = 96;
-    Clicks = 96;
-    T0 = 0;
-    M0 = 0;
-    mfread();
+    initfuncs(&r);
+    memset(&t, 0, sizeof(t));
+    newfile(&t, stdin, stdout);
+    r.data = &t;
+    memset(&map, 0, sizeof(map));
+    if (realtime)
+        t.map = &map;
+    if (Statsfp) {
+        memset(&st, 0, sizeof(st));
+        newstats(&r, &st);
+    }
+    status = readinput(&r);
+    flush(&t);
+    if (Statsfp)
+        report(&t, name, status);
 
     return 0;
 }
+#endif
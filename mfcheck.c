@@ -0,0 +1,181 @@
+/*
+ * mfcheck
+ *
+ * Check that MIDI files come back unchanged through mf2t and t2mf.
+ * Each file is converted to text and back to MIDI, all in memory, and
+ * the result is compared with the file byte for byte.  It is tried
+ * without running status and then, if that differs, with it (as
+ * t2mf -r).  Worker threads each take a file at a time.
+ *
+ * mf2t joins a sysex split into packets into one message unless it is
+ * given -m, so a file with one only comes back the same with -m here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if _POSIX_C_SOURCE >= 2
+#include <unistd.h>
+#else
+#include <io.h>
+#include "getopt.h"
+#endif
+
+#include "midifile.h"
+#include "batch.h"
+#include "mfcheck.h"
+#include "version.h"
+
+static int jobs = 1;		/* files at once */
+static int verbose = 0;		/* report the files that are fine too */
+static int nomerge = 1;		/* as mf2t’s; -m clears it */
+
+/* a buffer kept from one file to the next */
+struct input {
+    mf_data_t *buf;
+    mf_size_t leng, size;
+};
+
+/* read all of name into in; -1 if that failed */
+static int
+readfile(struct input *in, const char *name) {
+    FILE *fp;
+    mf_data_t *more;
+    size_t n;
+
+    if ((fp = fopen(name, "rb")) == NULL) {
+        perror(name);
+        return(-1);
+    }
+    in->leng = 0;
+    do {
+        if (in->leng == in->size) {
+            in->size = in->size ? 2 * in->size : 65536;
+            if ((more = realloc(in->buf, in->size)) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", name);
+                fclose(fp);
+                return(-1);
+            }
+            in->buf = more;
+        }
+        in->leng += n = fread(in->buf + in->leng, 1, in->size - in->leng, fp);
+    } while (n > 0);
+    if (ferror(fp)) {
+        perror(name);
+        fclose(fp);
+        return(-1);
+    }
+    fclose(fp);
+    return(0);
+}
+
+/*
+ * Check one file; -1 if it doesn’t come back the same.  Where it first
+ * differs is reported from whichever try got further.
+ */
+static int
+check(struct input *in, const char *name) {
+    char *text;
+    size_t leng;
+    mf_data_t *mid;
+    mf_size_t midleng, i, at = 0;
+    int runstat, same = 0;
+
+    if (readfile(in, name) < 0)
+        return(-1);
+    if ((text = mf2t_text(name, in->buf, in->leng, nomerge, &leng)) == NULL)
+        return(-1);
+    for (runstat = 0; runstat < 2 && !same; runstat++) {
+        if ((mid = t2mf_midi(name, text, leng, runstat, &midleng)) == NULL)
+            break;
+        for (i = 0; i < midleng && i < in->leng; i++)
+            if (mid[i] != in->buf[i])
+                break;
+        same = (i == midleng && i == in->leng);
+        if (i > at)
+            at = i;
+        free(mid);
+    }
+    free(text);
+    if (!same) {
+        if (runstat == 2)
+            fprintf(stderr, "%s: differs at byte %lu\n", name,
+                    (unsigned long)at);
+        return(-1);
+    }
+    if (verbose)
+        printf("%s: ok%s\n", name, runstat == 2 ? " (running status)" : "");
+    return(0);
+}
+
+/* check files until there are none left, counting failures in *arg */
+static void *
+worker(void *arg) {
+    int *failures = arg;
+    struct input in;
+    const char *name;
+
+    memset(&in, 0, sizeof(in));
+    while ((name = batch_next()) != NULL)
+        if (check(&in, name) < 0)
+            ++*failures;
+    free(in.buf);
+    return(NULL);
+}
+
+static void
+usage(void) {
+    fprintf(stderr,
+"mfcheck v%s\n"
+"Usage: mfcheck [-mv] [-j n] [-l list] [file|dir...]\n\n"
+"Options:\n"
+"  -m      as mf2t -m: don’t merge partial sysex\n"
+"  -v      also report the files that come back the same\n"
+"  -j n    check up to n files at once (default: one per CPU)\n"
+"  -l list also check the files named in list, one per line\n",
+	VERSION);
+    exit(1);
+}
+
+int
+main(int argc, char **argv) {
+    const char *list = NULL;
+    int c, failures, n;
+
+#if _POSIX_C_SOURCE >= 2 && defined(_SC_NPROCESSORS_ONLN)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    while ((c = getopt(argc, argv, "mvj:l:h")) != -1) {
+        switch (c) {
+	case 'm':
+	    nomerge = 0;
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 'l':
+	    list = optarg;
+	    break;
+	case 'h':
+	case '?':
+	default:
+	    usage();
+        }
+    }
+    if (list == NULL && optind == argc)
+        usage();
+
+    if (list)
+        batch_addlist(list, batch_ismidi);
+    while (optind < argc)
+        batch_addarg(argv[optind++], batch_ismidi);
+    n = batch_nfiles();
+    if ((failures = batch_run(jobs, worker)) > 0) {
+        fprintf(stderr, "mfcheck: %d of %d files differ\n", failures, n);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MFCHECK_H
+#define MFCHECK_H
+
+/*
+ * What mfcheck takes from mf2t.c and t2mf.c, which are built into it
+ * with MFCHECK defined (leaving out their main()s).  Each converts one
+ * file held in memory to another, may be called from several threads
+ * at once, and reports any errors on stderr with name in front.
+ */
+
+#include "midifile.h"
+
+/*
+ * The text for the len bytes of MIDI file at buf, as mf2t writes it
+ * with no options but -m if nomerge is 0; NULL if it can’t be
+ * converted.  The text is in a malloc’d buffer, and its length is put
+ * in *lengp.
+ */
+extern char *mf2t_text(const char *name, const mf_data_t *buf,
+        mf_size_t len, int nomerge, size_t *lengp);
+
+/*
+ * The MIDI file for the leng bytes of text at text, as t2mf writes it
+ * (with running status, as -r, if runstat is 1); NULL if there were
+ * errors.  The file is in a malloc’d buffer, and its length is put in
+ * *lengp.
+ */
+extern mf_data_t *t2mf_midi(const char *name, const char *text,
+        size_t leng, int runstat, mf_size_t *lengp);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * mfmerge
+ *
+ * Convert a format 1 MIDI file to format 0: the events of all its
+ * tracks in one, in time order (those at the same time in track order),
+ * with the delta times worked out again and, with -r, running status.
+ *
+ * The file is mapped (or read into memory) and each track has a reader
+ * of its own, which is fed the track a slice at a time whenever the
+ * events it has queued have all been written, so only a slice of each
+ * track is decoded at once.  A heap holds the tracks with events
+ * queued, by the time of the first and then by track, and the first
+ * event of the one on top is written next.  The End of Track events
+ * are left out, and one written at the time of the last of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if _POSIX_C_SOURCE >= 2
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <io.h>
+#include "getopt.h"
+#endif
+#include <sys/stat.h>
+
+#include "midifile.h"
+#include "version.h"
+
+#define SLICE 4096		/* bytes of a track decoded at a time */
+
+/* a track being decoded, and the events it has queued */
+struct cursor {
+    struct mf_reader r;
+    const mf_data_t *p, *end;	/* the part of the track still to decode */
+    struct mf_event ev;		/* the reader’s batch, of one */
+    struct mf_event *queue;
+    int nqueued, maxqueued;
+    int next;			/* the first not yet written */
+    mf_data_t *payload;		/* of those queued, each with its status */
+    mf_size_t leng, size;
+};
+
+static struct cursor *Cursors;
+static int NCursors;
+static int *Heap;		/* of the Cursors with events queued */
+static int NHeap;
+static int Format, Division;
+
+static void
+error(struct mf_reader *r, char *s) {
+    (void) r;
+    fprintf(stderr, "Error: %s\n", s);
+}
+
+static void
+werror(struct mf_writer *w, char *s) {
+    (void) w;
+    fprintf(stderr, "Error: %s\n", s);
+}
+
+static void *
+grow(void *p, size_t size) {
+    if ((p = realloc(p, size)) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return(p);
+}
+
+static void
+myheader(struct mf_reader *r, int format, int ntrks, int division) {
+    (void) r;
+    (void) ntrks;
+    Format = format;
+    Division = division;
+}
+
+/*
+ * The reader’s Mf_events: queue the event, and its payload.  Sysex
+ * payloads start with their 0xf0 already; the 0xf7 is put in front of
+ * others, as mf_w_sysex_event_r() wants it.
+ */
+static void
+myevents(struct mf_reader *r, const struct mf_event *ev, int n,
+        const char *payload) {
+    struct cursor *c = r->data;
+    struct mf_event *q;
+    mf_size_t need;
+
+    for (; n > 0; n--, ev++) {
+        if (c->nqueued == c->maxqueued) {
+            c->maxqueued = c->maxqueued ? 2 * c->maxqueued : 64;
+            c->queue = grow(c->queue, c->maxqueued * sizeof(*c->queue));
+        }
+        need = ev->leng + (ev->status == 0xf7);
+        if (c->leng + need > c->size) {
+            do
+                c->size = c->size ? 2 * c->size : SLICE;
+            while (c->leng + need > c->size);
+            c->payload = grow(c->payload, c->size);
+        }
+        q = &c->queue[c->nqueued++];
+        *q = *ev;
+        q->offset = c->leng;
+        q->leng = need;
+        if (ev->status == 0xf7)
+            c->payload[c->leng++] = 0xf7;
+        memcpy(c->payload + c->leng, payload + ev->offset, ev->leng);
+        c->leng += ev->leng;
+    }
+}
+
+/* decode c’s track until an event is queued or it ends */
+static void
+refill(struct cursor *c) {
+    mf_size_t n;
+
+    c->nqueued = c->next = 0;
+    c->leng = 0;
+    while (c->nqueued == 0 && c->p < c->end) {
+        n = c->end - c->p < SLICE ? c->end - c->p : SLICE;
+        mfread_feed_tracks_r(&c->r, c->p, n);
+        c->p += n;
+        if (c->p == c->end)
+            mfread_finish_r(&c->r);
+    }
+}
+
+/* 1 if the next event of cursor a comes before that of b */
+static int
+before(int a, int b) {
+    mf_deltat_t ta = Cursors[a].queue[Cursors[a].next].time;
+    mf_deltat_t tb = Cursors[b].queue[Cursors[b].next].time;
+
+    return(ta < tb || (ta == tb && a < b));
+}
+
+/* move Heap[i] down to where it belongs */
+static void
+siftdown(int i) {
+    int k, top = Heap[i];
+
+    while ((k = 2 * i + 1) < NHeap) {
+        if (k + 1 < NHeap && before(Heap[k + 1], Heap[k]))
+            k++;
+        if (!before(Heap[k], top))
+            break;
+        Heap[i] = Heap[k];
+        i = k;
+    }
+    Heap[i] = top;
+}
+
+/* the writer’s Mf_wtrack: all the events, merged */
+static void
+mywritetrack(struct mf_writer *w) {
+    struct cursor *c;
+    struct mf_event *ev;
+    mf_deltat_t last = 0, end = 0;
+    mf_data_t data[2];
+    int i;
+
+    for (i = 0; i < NCursors; i++) {
+        refill(&Cursors[i]);
+        if (Cursors[i].nqueued > 0)
+            Heap[NHeap++] = i;
+    }
+    for (i = NHeap / 2 - 1; i >= 0; i--)
+        siftdown(i);
+
+    while (NHeap > 0) {
+        c = &Cursors[Heap[0]];
+        ev = &c->queue[c->next++];
+        if (ev->status < 0xf0) {
+            data[0] = ev->data1;
+            data[1] = ev->data2;
+            mf_w_midi_event_r(w, ev->time - last, ev->status & 0xf0,
+                    ev->status & 0xf, data, (ev->status & 0xe0) == 0xc0 ? 1 : 2);
+            last = ev->time;
+        } else if (ev->status != 0xff) {
+            mf_w_sysex_event_r(w, ev->time - last, c->payload + ev->offset,
+                    ev->leng);
+            last = ev->time;
+        } else if (ev->data1 != end_of_track) {
+            mf_w_meta_event_r(w, ev->time - last, ev->data1,
+                    c->payload + ev->offset, ev->leng);
+            last = ev->time;
+        } else if (ev->time > end)
+            end = ev->time;
+        if (c->next == c->nqueued) {
+            refill(c);
+            if (c->nqueued == 0)
+                Heap[0] = Heap[--NHeap];
+        }
+        siftdown(0);
+    }
+    mf_w_meta_event_r(w, end > last ? end - last : 0, end_of_track, NULL, 0);
+}
+
+/* find the track chunks of the len bytes at buf, and a reader for each */
+static void
+findtracks(const mf_data_t *buf, mf_size_t len, mf_size_t offset) {
+    const mf_data_t *p, *end = buf + len;
+    struct cursor *c;
+    uint32_t clen;
+
+    /* anything after the last whole chunk is left to the last reader */
+    for (p = buf; p < end; p += clen) {
+        clen = end - p;
+        if (end - p >= 8 && memcmp(p, "MTrk", 4) == 0) {
+            clen = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+            if (clen & 0x80000000 || clen > (mf_size_t)(end - p) - 8)
+                clen = end - p;
+            else
+                clen += 8;
+        }
+        if ((NCursors & (NCursors - 1)) == 0)
+            Cursors = grow(Cursors,
+                    (NCursors ? 2*NCursors : 1) * sizeof(*Cursors));
+        c = &Cursors[NCursors];
+        memset(c, 0, sizeof(*c));
+        mf_reader_init(&c->r);
+        c->r.Mf_rerror = error;
+        c->r.Mf_events = myevents;
+        c->r.maxevents = 1;
+        c->r.track = NCursors;
+        c->r.offset = offset + (p - buf);
+        c->p = p;
+        c->end = p + clen;
+        NCursors++;
+    }
+    for (c = Cursors; c < Cursors + NCursors; c++) {	/* now they stay put */
+        c->r.events = &c->ev;
+        c->r.data = c;
+    }
+    Heap = grow(NULL, (NCursors ? NCursors : 1) * sizeof(*Heap));
+}
+
+static int
+myputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    (void) w;
+    return(fwrite(buf, 1, size, stdout));
+}
+
+/* all of stdin, in *lenp bytes; mapped if it can be */
+static mf_data_t *
+readinput(mf_size_t *lenp) {
+    struct stat st;
+    mf_data_t *buf = NULL;
+    size_t len = 0, size = 0, n;
+
+#if _POSIX_C_SOURCE >= 2
+    if (fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0 && (buf = mmap(NULL, st.st_size, PROT_READ,
+            MAP_PRIVATE, fileno(stdin), 0)) != MAP_FAILED) {
+        *lenp = st.st_size;
+        return(buf);
+    }
+    buf = NULL;
+#else
+    (void) st;
+#endif
+    do {
+        if (len == size) {
+            size = size ? 2 * size : 65536;
+            buf = grow(buf, size);
+        }
+        len += n = fread(buf + len, 1, size - len, stdin);
+    } while (n > 0);
+    if (ferror(stdin)) {
+        perror("read");
+        exit(1);
+    }
+    *lenp = len;
+    return(buf);
+}
+
+static void
+usage(void) {
+    fprintf(stderr,
+"mfmerge v%s\n"
+"Usage: mfmerge [-r] [midifile [midifile]]\n\n"
+"Convert a format 1 midifile to format 0.\n\n"
+"Options:\n"
+"  -r      use running status\n",
+	VERSION);
+    exit(1);
+}
+
+int
+main(int argc, char **argv) {
+    struct mf_reader r;
+    struct mf_writer w;
+    const mf_data_t *buf;
+    mf_size_t len, n;
+    int c;
+
+    mf_writer_init(&w);
+    while ((c = getopt(argc, argv, "rh")) != -1) {
+        switch (c) {
+	case 'r':
+	    w.runstat = 1;
+	    break;
+	case 'h':
+	case '?':
+	default:
+	    usage();
+        }
+    }
+
+    if (optind < argc && !freopen(argv[optind++], "rb", stdin)) {
+	perror(argv[optind - 1]);
+        exit(1);
+    }
+    if (optind < argc && !freopen(argv[optind], "wb", stdout)) {
+	perror(argv[optind]);
+        exit(1);
+    }
+
+    buf = readinput(&len);
+    mf_reader_init(&r);
+    r.Mf_rerror = error;
+    r.Mf_header = myheader;
+    n = mfread_header_buf_r(&r, buf, len);
+    if (Format == 2) {
+        fprintf(stderr, "Can’t merge the tracks of a format 2 file\n");
+        exit(1);
+    }
+    findtracks(buf + n, len - n, n);
+
+    w.Mf_putbuf = myputbuf;
+    w.Mf_wtrack = mywritetrack;
+    w.Mf_werror = werror;
+    mf_w_header_r(&w, 0, 1, Division);
+    mf_w_track_r(&w);
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        perror("write");
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * mfsplit
+ *
+ * Convert a format 0 MIDI file to format 1: a conductor track with the
+ * meta and sysex events, then a track for each channel used, in order,
+ * with its channel messages.
+ *
+ * The file is read and decoded once, as it comes.  Each event goes
+ * straight to a writer for its track, which keeps the track chunk in
+ * memory (see mf_w_track_begin_r()), with the delta time from the last
+ * event put in that track.  At the end the header is written, then the
+ * chunks, each with an End of Track at the time of the one read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if _POSIX_C_SOURCE >= 2
+#include <unistd.h>
+#else
+#include <io.h>
+#include "getopt.h"
+#endif
+
+#include "midifile.h"
+#include "version.h"
+
+/* the conductor track, then one a channel */
+struct track {
+    struct mf_writer w;
+    mf_deltat_t last;		/* the time of the last event written */
+    int used;
+};
+
+static struct track Tracks[17];
+static int RunStat;
+static int Division, NTracks;
+static mf_deltat_t End;		/* the time of the End of Track */
+static mf_data_t *Scratch;	/* a payload, with its status */
+static mf_size_t ScratchSize;
+
+static void
+error(struct mf_reader *r, char *s) {
+    (void) r;
+    fprintf(stderr, "Error: %s\n", s);
+}
+
+static void
+werror(struct mf_writer *w, char *s) {
+    (void) w;
+    fprintf(stderr, "Error: %s\n", s);
+}
+
+static int
+myputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    (void) w;
+    return(fwrite(buf, 1, size, stdout));
+}
+
+static void
+myheader(struct mf_reader *r, int format, int ntrks, int division) {
+    (void) r;
+    (void) ntrks;
+    if (format != 0) {
+        fprintf(stderr, "Can’t split the tracks of a format %d file\n",
+                format);
+        exit(1);
+    }
+    Division = division;
+}
+
+static void
+mystarttrack(struct mf_reader *r) {
+    (void) r;
+    if (NTracks++ > 0) {
+        fprintf(stderr, "Error: more than one track in a format 0 file\n");
+        exit(1);
+    }
+}
+
+/* the track for events at time, begun if it is new; its delta time */
+static struct track *
+track(int i, mf_deltat_t time, mf_deltat_t *delta) {
+    struct track *t = &Tracks[i];
+
+    if (!t->used) {
+        mf_writer_init(&t->w);
+        t->w.Mf_putbuf = myputbuf;
+        t->w.Mf_werror = werror;
+        t->w.runstat = RunStat;
+        mf_w_track_begin_r(&t->w);
+        t->used = 1;
+    }
+    *delta = time - t->last;
+    t->last = time;
+    return(t);
+}
+
+/*
+ * The reader’s Mf_events: write each event to its track.  The 0xf7 is
+ * put in front of arbitrary bytes, as mf_w_sysex_event_r() wants it.
+ */
+static void
+myevents(struct mf_reader *r, const struct mf_event *ev, int n,
+        const char *payload) {
+    struct track *t;
+    mf_deltat_t delta;
+    mf_data_t data[2];
+    mf_size_t leng;
+
+    (void) r;
+    for (; n > 0; n--, ev++) {
+        if (ev->status < 0xf0) {
+            t = track(1 + (ev->status & 0xf), ev->time, &delta);
+            data[0] = ev->data1;
+            data[1] = ev->data2;
+            mf_w_midi_event_r(&t->w, delta, ev->status & 0xf0,
+                    ev->status & 0xf, data, (ev->status & 0xe0) == 0xc0 ? 1 : 2);
+            continue;
+        }
+        if (ev->status == 0xff && ev->data1 == end_of_track) {
+            End = ev->time;
+            continue;
+        }
+        leng = ev->leng + (ev->status == 0xf7);
+        if (leng > ScratchSize) {
+            do
+                ScratchSize = ScratchSize ? 2 * ScratchSize : 1024;
+            while (leng > ScratchSize);
+            if ((Scratch = realloc(Scratch, ScratchSize)) == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+        }
+        if (ev->status == 0xf7)
+            Scratch[0] = 0xf7;
+        memcpy(Scratch + (ev->status == 0xf7), payload + ev->offset, ev->leng);
+        t = track(0, ev->time, &delta);
+        if (ev->status == 0xff)
+            mf_w_meta_event_r(&t->w, delta, ev->data1, Scratch, leng);
+        else
+            mf_w_sysex_event_r(&t->w, delta, Scratch, leng);
+    }
+}
+
+static void
+usage(void) {
+    fprintf(stderr,
+"mfsplit v%s\n"
+"Usage: mfsplit [-r] [midifile [midifile]]\n\n"
+"Convert a format 0 midifile to format 1, a track for each channel.\n\n"
+"Options:\n"
+"  -r      use running status\n",
+	VERSION);
+    exit(1);
+}
+
+int
+main(int argc, char **argv) {
+    static mf_data_t buf[65536];
+    struct mf_event events[1024];
+    struct mf_reader r;
+    struct mf_writer h;
+    struct track *t;
+    mf_deltat_t delta;
+    size_t n;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "rh")) != -1) {
+        switch (c) {
+	case 'r':
+	    RunStat = 1;
+	    break;
+	case 'h':
+	case '?':
+	default:
+	    usage();
+        }
+    }
+
+    if (optind < argc && !freopen(argv[optind++], "rb", stdin)) {
+	perror(argv[optind - 1]);
+        exit(1);
+    }
+    if (optind < argc && !freopen(argv[optind], "wb", stdout)) {
+	perror(argv[optind]);
+        exit(1);
+    }
+
+    mf_reader_init(&r);
+    r.Mf_rerror = error;
+    r.Mf_header = myheader;
+    r.Mf_starttrack = mystarttrack;
+    r.Mf_events = myevents;
+    r.events = events;
+    r.maxevents = sizeof(events) / sizeof(events[0]);
+    track(0, 0, &delta);		/* there is always a conductor track */
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)
+        mfread_feed_r(&r, buf, n);
+    if (ferror(stdin)) {
+        perror("read");
+        exit(1);
+    }
+    mfread_finish_r(&r);
+
+    for (i = n = 0; i < 17; i++)
+        n += Tracks[i].used;
+    mf_writer_init(&h);
+    h.Mf_putbuf = myputbuf;
+    h.Mf_werror = werror;
+    mf_w_header_r(&h, 1, n, Division);
+    for (t = Tracks; t < Tracks + 17; t++) {
+        if (!t->used)
+            continue;
+        mf_w_meta_event_r(&t->w, End > t->last ? End - t->last : 0,
+                end_of_track, NULL, 0);
+        mf_w_track_end_r(&t->w);
+        mf_writer_free(&t->w);
+    }
+    mf_writer_free(&h);
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        perror("write");
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * The worker threads that do the tracks of one file at once for mf2t
+ * and t2mf; see partrack.h.
+ */
+
+#include <stdlib.h>
+#if _POSIX_C_SOURCE >= 2
+#include <pthread.h>
+#endif
+
+#include "partrack.h"
+
+#if _POSIX_C_SOURCE >= 2
+enum { TRK_TODO, TRK_TAKEN, TRK_DONE, TRK_FAILED };
+
+static int *States;		/* of each track */
+static int NTracks;
+static int NextTrack;		/* next track for a worker to take */
+static int Stopped;		/* a track failed: take no more */
+static pthread_t *Threads;
+static int NThreads;
+static int (*Dotrack)(void **state, int i);
+static void (*Freestate)(void *state);
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Changed = PTHREAD_COND_INITIALIZER;
+
+static void *
+worker(void *arg) {
+    void *state = NULL;
+    int i, done;
+
+    (void) arg;
+    for (;;) {
+        pthread_mutex_lock(&Lock);
+        if ((i = NextTrack < NTracks ? NextTrack++ : -1) >= 0)
+            States[i] = TRK_TAKEN;
+        pthread_mutex_unlock(&Lock);
+        if (i < 0)
+            break;
+        done = Dotrack(&state, i);
+        pthread_mutex_lock(&Lock);
+        States[i] = done ? TRK_DONE : TRK_FAILED;
+        if (!done) {
+            NextTrack = NTracks;	/* the rest will be done again */
+            Stopped = 1;
+        }
+        pthread_cond_broadcast(&Changed);
+        pthread_mutex_unlock(&Lock);
+    }
+    if (state)
+        Freestate(state);
+    return(NULL);
+}
+#endif
+
+int
+partrack_run(int ntracks, int jobs, int (*dotrack)(void **state, int i),
+        void (*freestate)(void *state)) {
+#if _POSIX_C_SOURCE >= 2
+    int i, nthreads = jobs < ntracks ? jobs : ntracks;
+
+    if (nthreads < 2)
+        return(-1);
+    if ((Threads = malloc(nthreads * sizeof(*Threads))) == NULL ||
+            (States = malloc(ntracks * sizeof(*States))) == NULL) {
+        free(Threads);
+        Threads = NULL;
+        return(-1);
+    }
+    for (i = 0; i < ntracks; i++)
+        States[i] = TRK_TODO;
+    NTracks = ntracks;
+    NextTrack = Stopped = 0;
+    Dotrack = dotrack;
+    Freestate = freestate;
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&Threads[i], NULL, worker, NULL) != 0)
+            break;
+    NThreads = i;
+    if (NThreads == 0)
+        worker(NULL);		/* do them all here, then */
+    return(0);
+#else
+    (void) ntracks;
+    (void) jobs;
+    (void) dotrack;
+    (void) freestate;
+    return(-1);
+#endif
+}
+
+int
+partrack_wait(int i) {
+#if _POSIX_C_SOURCE >= 2
+    int state;
+
+    pthread_mutex_lock(&Lock);
+    while ((state = States[i]) == TRK_TAKEN ||
+            (state == TRK_TODO && !Stopped))
+        pthread_cond_wait(&Changed, &Lock);
+    pthread_mutex_unlock(&Lock);
+    return(state == TRK_DONE);
+#else
+    (void) i;
+    return(0);
+#endif
+}
+
+void
+partrack_end(void) {
+#if _POSIX_C_SOURCE >= 2
+    int i;
+
+    pthread_mutex_lock(&Lock);
+    NextTrack = NTracks;
+    pthread_mutex_unlock(&Lock);
+    for (i = 0; i < NThreads; i++)
+        pthread_join(Threads[i], NULL);
+    free(Threads);
+    free(States);
+    Threads = NULL;
+    States = NULL;
+    NTracks = NThreads = 0;
+#endif
+}
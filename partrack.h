@@ -0,0 +1,29 @@
+#ifndef PARTRACK_H
+#define PARTRACK_H
+
+/*
+ * The threads with which mf2t and t2mf do the tracks of one file at
+ * once.  partrack_run() starts up to jobs of them, each calling dotrack
+ * for the next track not yet taken, which returns 1 if the track was
+ * done cleanly.  The caller then takes the tracks in order, each once
+ * partrack_wait() says it was done, and partrack_end() waits for the
+ * threads to stop.  When a track fails no more are started, and that
+ * track and everything after it are for the caller to do again in the
+ * usual way, so the output and any error messages are just as they
+ * would have been without threads.
+ *
+ * *state is the worker’s own, NULL to start with, for dotrack to keep
+ * what it needs from one track to the next; freestate is called on it
+ * when the worker stops.  Only one file may be done at a time.
+ */
+
+/* 0, or -1 (and nothing started) if it isn’t worth it or can’t be done */
+extern int partrack_run(int ntracks, int jobs,
+        int (*dotrack)(void **state, int i), void (*freestate)(void *state));
+
+/* 1 once track i is done, 0 if it failed or wasn’t started */
+extern int partrack_wait(int i);
+
+extern void partrack_end(void);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * The -S statistics of mf2t and t2mf; see stats.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+double
+stats_now(void) {
+#if _POSIX_C_SOURCE >= 199309L
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+#else
+    return((double)clock() / CLOCKS_PER_SEC);
+#endif
+}
+
+void
+stats_begin(struct stats *st) {
+    struct trkstats *trk = st->trk;
+    int maxtrk = st->maxtrk;
+
+    memset(st, 0, sizeof(*st));
+    st->trk = trk;
+    st->maxtrk = maxtrk;
+    st->start = stats_now();
+}
+
+struct trkstats *
+stats_track(struct stats *st, int n) {
+    struct trkstats *more;
+    int size = st->maxtrk;
+
+    if (n >= size) {
+        do
+            size = size ? 2 * size : 16;
+        while (n >= size);
+        if ((more = realloc(st->trk, size * sizeof(*more))) == NULL)
+            return(NULL);
+        st->trk = more;
+        st->maxtrk = size;
+    }
+    while (st->ntrk <= n)
+        memset(&st->trk[st->ntrk++], 0, sizeof(*st->trk));
+    return(&st->trk[n]);
+}
+
+/* times are in microseconds; the phase includes what isn’t read or write */
+void
+stats_report(FILE *fp, const char *name, const struct stats *st,
+        const char *phase, uint64_t in, uint64_t out, int status) {
+    double total = stats_now() - st->start;
+    char *prefix;
+    int i;
+
+    if ((prefix = malloc(strlen(name) + 7)) == NULL)
+        return;
+    sprintf(prefix, "file=%s ", name);
+#if _POSIX_C_SOURCE >= 2
+    flockfile(fp);
+#endif
+    fprintf(fp, "%sstatus=%s bytes_in=%llu bytes_out=%llu tracks=%llu "
+            "events=%llu reallocs=%llu us=%.0f\n", prefix,
+            status < 0 ? "failed" : "ok", (unsigned long long)in,
+            (unsigned long long)out, (unsigned long long)st->lib.tracks,
+            (unsigned long long)st->lib.events,
+            (unsigned long long)st->lib.reallocs, total * 1e6);
+    fprintf(fp, "%sphase=read us=%.0f\n", prefix, st->read * 1e6);
+    fprintf(fp, "%sphase=%s us=%.0f\n", prefix, phase,
+            (total - st->read - st->write) * 1e6);
+    fprintf(fp, "%sphase=write us=%.0f\n", prefix, st->write * 1e6);
+    for (i = 0; i < st->ntrk; i++)
+        fprintf(fp, "%strack=%d events=%llu bytes_out=%llu us=%.0f\n",
+                prefix, i + 1, (unsigned long long)st->trk[i].events,
+                (unsigned long long)st->trk[i].bytes, st->trk[i].secs * 1e6);
+    mf_stats_print(fp, prefix, &st->lib);
+    fflush(fp);
+#if _POSIX_C_SOURCE >= 2
+    funlockfile(fp);
+#endif
+    free(prefix);
+}
+
+void
+stats_free(struct stats *st) {
+    free(st->trk);
+    st->trk = NULL;
+    st->ntrk = st->maxtrk = 0;
+}
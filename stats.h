@@ -0,0 +1,48 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#include "midifile.h"
+
+/*
+ * -S for mf2t and t2mf: what is counted for a file.  The library
+ * counts the events, the bytes of the MIDI file and the buffers grown
+ * in lib (the tools’ own buffers too); the rest is timed by the tool.
+ */
+struct trkstats {
+    uint64_t events;
+    uint64_t bytes;		/* of its text (mf2t) or chunk (t2mf) */
+    double secs;		/* to decode or translate it */
+};
+
+struct stats {
+    struct mf_stats lib;
+    double start;		/* when the file was begun */
+    double read;		/* seconds reading the input */
+    double write;		/* and writing the output */
+    struct trkstats *trk;	/* for each track */
+    int ntrk, maxtrk;
+};
+
+/* seconds since some fixed time */
+extern double stats_now(void);
+
+/* start counting for a new file, keeping the track array */
+extern void stats_begin(struct stats *st);
+
+/* the counts for track n (from 0), made room for; NULL if there’s none */
+extern struct trkstats *stats_track(struct stats *st, int n);
+
+/*
+ * Write what was counted for the file name to fp, a line for the file,
+ * each phase, each track and each kind of event, all of the form
+ * “file=name key=value ...”; phase is what was done between reading
+ * and writing, and in and out the bytes of each.
+ */
+extern void stats_report(FILE *fp, const char *name, const struct stats *st,
+        const char *phase, uint64_t in, uint64_t out, int status);
+
+extern void stats_free(struct stats *st);
+
+#endif
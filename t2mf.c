@@ -16,121 +16,210 @@
 #endif
 #include <errno.h>
 #include <ctype.h>
-#include <setjmp.h>
 
 #include "t2mf.h"
+#include "batch.h"
+#include "mfcheck.h"
+#include "partrack.h"
+#include "stats.h"
 #include "version.h"
 
-static jmp_buf erjump;
-static int err_cont = 0;
-
+static int jobs = 1;			/* tracks (files, in batch mode) at once */
+#ifndef MFCHECK
 static int TrkNr;
-static int Format, Ntrks;
-static int Measure, M0, Beat, Clicks;
-static mf_ticks_t T0;
-static mf_data_t *buffer = 0;
-static mf_size_t bufsiz = 0, buflen;
-
-static void checkeol(void);
+static int runstat = 0;			/* use running status */
+static int batch = 0;			/* translate many files */
+static const char *outdir;		/* where batch mode puts the MIDI files */
+static FILE *Statsfp;			/* -S: where to write the statistics */
+#else
+static int batch = 1;			/* mfcheck does, so don’t exit */
+#endif
 
-int
-yywrap(void) {
-    return 1;
-}
+static void finishline(struct t2mf *t);
 
-void					/* used in t2mf.fl */
-error(const char *s) {
-    fprintf(stderr, "Error: %s\n", s);
+void					/* used in t2mfscan.c */
+error(struct t2mf *t, const char *s) {
+    t->errors++;
+    if (t->quiet)
+        return;
+    if (t->name)
+        fprintf(stderr, "%s: Error: %s\n", t->name, s);
+    else
+        fprintf(stderr, "Error: %s\n", s);
 }
 
-static void
-prs_error(char *s) {			/* parse error */
+/*
+ * Report a parse error and skip the rest of the line.  Returns -1, for
+ * the caller to pass back up to mywritetrack(), which goes on with the
+ * next line (or, in batch mode, gives up at EOF).
+ */
+static int
+prs_error(struct t2mf *t, char *s) {
     int c;
     int count;
-    int ln = (eol_seen? lineno-1 : lineno);
-    fprintf(stderr, "%d: %s\n", ln, s);
-    if (gyyleng() > 0 && *yytext != '\n')
-        fprintf(stderr, "*** %*s ***\n", (int)gyyleng(), yytext);
+    int ln;
+    t->errors++;
+    if (!t->quiet) {
+        ln = (t->eol_seen? t->lineno-1 : t->lineno);
+        if (t->name)
+            fprintf(stderr, "%s: %d: %s\n", t->name, ln, s);
+        else
+            fprintf(stderr, "%d: %s\n", ln, s);
+        if (t->yyleng > 0 && *t->yytext != '\n')
+            fprintf(stderr, "%s%s*** %.*s ***\n", t->name ? t->name : "",
+                    t->name ? ": " : "", (int)t->yyleng, t->yytext);
+    }
     count = 0;
     /* skip rest of line */
-    while (count < 100 && (c = yylex()) != EOL && c != EOF) count++;
-    if (c == EOF) exit(1);
-    if (err_cont)
-        longjmp(erjump, 1);
+    while (count < 100 && (c = yylex(t)) != EOL && c != EOF) count++;
+    if (c == EOF && !t->quiet) {
+        if (!batch)
+            exit(1);
+        t->stopped = 1;
+    }
+    return(-1);
 }
 
-static void
-syntax(void) {
-    prs_error("Syntax error");
+static int
+syntax(struct t2mf *t) {
+    return prs_error(t, "Syntax error");
 }
 
 static int
-getint(char *mess) {
+getint(struct t2mf *t, char *mess) {
     char ermesg[100];
-    if (yylex() != INT) {
+    if (yylex(t) != INT) {
         sprintf(ermesg, "Integer expected for %s", mess);
-        error(ermesg);
-        yyval = 0;
+        error(t, ermesg);
+        t->yyval = 0;
     }
-    return yyval;
+    return t->yyval;
 }
 
+/* count a buffer of ours grown, for -S */
+#define GROWN(t) if ((t)->w->stats) (t)->w->stats->reallocs++
+
 static int
-getbyte(char *mess) {
+getbyte(struct t2mf *t, char *mess) {
     char ermesg[100];
-    getint(mess);
-    if (yyval < 0 || yyval > 127) {
-        sprintf(ermesg, "Wrong value (%d) for %s", yyval, mess);
-        error(ermesg);
-        yyval = 0;
+    getint(t, mess);
+    if (t->yyval < 0 || t->yyval > 127) {
+        sprintf(ermesg, "Wrong value (%d) for %s", t->yyval, mess);
+        error(t, ermesg);
+        t->yyval = 0;
     }
-    return yyval;
+    return t->yyval;
 }
 
-static void
-translate(void) {
-    int c;
+/* a whole chunk at a time, so stdout may be a pipe */
+static int
+myputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    struct t2mf *t = w->data;
+    double start;
+    int n;
+
+    if (t->out) {
+        start = t->st ? stats_now() : 0;
+        n = fwrite(buf, 1, size, t->out);
+        if (t->st)
+            t->st->write += stats_now() - start;
+        return(n);
+    }
+    if (t->outleng + size > t->outsize) {
+        do
+            t->outsize = t->outsize ? 2 * t->outsize : 4096;
+        while (t->outleng + size > t->outsize);
+        t->outbuf = realloc(t->outbuf, t->outsize);
+        if (!t->outbuf)
+            return(-1);
+        GROWN(t);
+    }
+    memcpy(t->outbuf + t->outleng, buf, size);
+    t->outleng += size;
+    return(size);
+}
+
+/* mf_w_track_r(), counted for -S as track n (from 0) */
+static int
+writetrack(struct t2mf *t, int n) {
+    struct mf_stats *s = t->w->stats;
+    struct trkstats *ts;
+    uint64_t events = s ? s->events : 0, bytes = s ? s->bytes : 0;
+    double start = t->st ? stats_now() : 0;
+    int status = mf_w_track_r(t->w);
+
+    if (t->st && s && (ts = stats_track(t->st, n)) != NULL) {
+        ts->events = s->events - events;
+        ts->bytes = s->bytes - bytes;
+        ts->secs = stats_now() - start;
+    }
+    return(status);
+}
+
+static void mywritetrack(struct mf_writer *w);
+#if _POSIX_C_SOURCE >= 2
+static int partracks(struct t2mf *t);
+#endif
 
-    /* Skip byte order mark */
-    if ((c = getchar()) == 0xef) {
-        if (getchar() != 0xbb || getchar() != 0xbf) {
-            error("Unknown byte order mark");
+/* translate t->in to a MIDI file; -1 if there were errors */
+static int
+translate(struct t2mf *t) {
+    int i = 0, format;
+    double start = t->st ? stats_now() : 0;
+
+    if (yyload(t, t->in) < 0) {
+        error(t, "Unknown byte order mark");
+        if (!batch)
             exit(1);
-        }
-    } else
-        ungetc(c, stdin);
-
-    if (yylex()==MTHD) {
-        Format = getint("MFile format");
-        Ntrks = getint("MFile #tracks");
-        Clicks = getint("MFile Clicks");
-        if (Clicks < 0)
-            Clicks = (Clicks&0xff)<<8|getint("MFile SMPTE division");
-        checkeol();
-        mfwrite(Format, Ntrks, Clicks, stdout);
+        return(-1);
+    }
+    t->textleng = t->end - t->cur;
+    if (t->st)
+        t->st->read += stats_now() - start;
+
+    if (yylex(t)==MTHD) {
+        format = getint(t, "MFile format");
+        t->ntrks = getint(t, "MFile #tracks");
+        t->clicks = getint(t, "MFile Clicks");
+        if (t->clicks < 0)
+            t->clicks = (t->clicks&0xff)<<8|getint(t, "MFile SMPTE division");
+        finishline(t);
+        if (mf_w_header_r(t->w, format, t->ntrks, t->clicks) < 0)
+            return(-1);
+#if _POSIX_C_SOURCE >= 2
+        if (jobs > 1 && !t->w->trace_output && !batch)
+            i = partracks(t);
+#endif
+        for (; i < t->ntrks && !t->stopped; i++)
+            if (writetrack(t, i) < 0)
+                return(-1);
     } else {
-        fprintf(stderr, "Missing MFile – can’t continue\n");
-        exit(1);
+        if (t->name)
+            fprintf(stderr, "%s: Missing MFile – can’t continue\n", t->name);
+        else
+            fprintf(stderr, "Missing MFile – can’t continue\n");
+        if (!batch)
+            exit(1);
+        return(-1);
     }
+    return(t->errors || t->stopped ? -1 : 0);
 }
 
-static mf_data_t data[5];
-static int chan;
-
-static void
-checkchan(void) {
-    if (yylex() != CH || yylex() != INT) syntax();
-    if (yyval < 1 || yyval > 16)
-        error("Chan must be between 1 and 16");
-    chan = yyval-1;
+static int
+checkchan(struct t2mf *t) {
+    if (yylex(t) != CH || yylex(t) != INT) return syntax(t);
+    if (t->yyval < 1 || t->yyval > 16)
+        error(t, "Chan must be between 1 and 16");
+    t->chan = t->yyval-1;
+    return(0);
 }
 
-static void
-checknote(void) {
+static int
+checknote(struct t2mf *t) {
     int c = -9;
-    if (yylex() != NOTE || ((c=yylex()) != INT && c != NOTEVAL))
-        syntax();
-    if (c == NOTEVAL) {
+    if (yylex(t) != NOTE || ((c=yylex(t)) != INT && c != NOTEVAL))
+        return syntax(t);
+    if (c == NOTEVAL) {		/* yyval is the octave */
         static int notes[] = {
             9,   /* a */
             11,  /* b */
@@ -140,104 +229,117 @@ checknote(void) {
             5,   /* f */
             7    /* g */
         };
-        char *p = yytext;
+        char *p = t->yytext;
+        int octave = t->yyval;
         c = *p++;
         if (isupper(c)) c = tolower(c);
-        yyval = notes[c-'a'];
+        t->yyval = notes[c-'a'];
         switch (*p) {
             case '#':
             case '+':
-                yyval++;
-                p++;
+                t->yyval++;
                 break;
             case 'b':
             case 'B':
             case '-':
-                yyval--;
-                p++;
+                t->yyval--;
                 break;
         }	
-        yyval += 12 * atoi(p);
+        t->yyval += 12 * octave;
     }
-    if (yyval < 0 || yyval > 127)
-        error("Note must be between 0 and 127");
-    data[0] = yyval;
+    if (t->yyval < 0 || t->yyval > 127)
+        error(t, "Note must be between 0 and 127");
+    t->data[0] = t->yyval;
+    return(0);
 }
 
-static void
-checkval(void) {
-    if (yylex() != VAL || yylex() != INT) syntax();
-    if (yyval < 0 || yyval > 127)
-        error("Value must be between 0 and 127");
-    data[1] = yyval;
+static int
+checkval(struct t2mf *t) {
+    if (yylex(t) != VAL || yylex(t) != INT) return syntax(t);
+    if (t->yyval < 0 || t->yyval > 127)
+        error(t, "Value must be between 0 and 127");
+    t->data[1] = t->yyval;
+    return(0);
 }
 
-static void
-splitval(void) {
-    if (yylex() != VAL || yylex() != INT) syntax();
-    if (yyval < 0 || yyval > 16383)
-        error("Value must be between 0 and 16383");
-    data[0] = yyval%128;
-    data[1] = yyval/128;
+static int
+splitval(struct t2mf *t) {
+    if (yylex(t) != VAL || yylex(t) != INT) return syntax(t);
+    if (t->yyval < 0 || t->yyval > 16383)
+        error(t, "Value must be between 0 and 16383");
+    t->data[0] = t->yyval%128;
+    t->data[1] = t->yyval/128;
+    return(0);
 }
 
-static void
-get16val(void) {
-    if (yylex() != VAL || yylex() != INT) syntax();
-    if (yyval < 0 || yyval > 65535)
-        error("Value must be between 0 and 65535");
-    data[0] = (yyval>>8)&0xff;
-    data[1] = yyval&0xff;
+static int
+get16val(struct t2mf *t) {
+    if (yylex(t) != VAL || yylex(t) != INT) return syntax(t);
+    if (t->yyval < 0 || t->yyval > 65535)
+        error(t, "Value must be between 0 and 65535");
+    t->data[0] = (t->yyval>>8)&0xff;
+    t->data[1] = t->yyval&0xff;
+    return(0);
 }
 
-static void
-checkcon(void) {
-    if (yylex() != CON || yylex() != INT)
-        syntax();
-    if (yyval < 0 || yyval > 127)
-        error("Controller must be between 0 and 127");
-    data[0] = yyval;
+static int
+checkcon(struct t2mf *t) {
+    if (yylex(t) != CON || yylex(t) != INT)
+        return syntax(t);
+    if (t->yyval < 0 || t->yyval > 127)
+        error(t, "Controller must be between 0 and 127");
+    t->data[0] = t->yyval;
+    return(0);
 }
 
-static void
-checkprog(void) {
-    if (yylex() != PROG || yylex() != INT) syntax();
-    if (yyval < 0 || yyval > 127)
-        error("Program number must be between 0 and 127");
-    data[0] = yyval;
+static int
+checkprog(struct t2mf *t) {
+    if (yylex(t) != PROG || yylex(t) != INT) return syntax(t);
+    if (t->yyval < 0 || t->yyval > 127)
+        error(t, "Program number must be between 0 and 127");
+    t->data[0] = t->yyval;
+    return(0);
 }
 
-static void
-checkeol(void) {
-    if (eol_seen) return;
-    if (yylex() != EOL) {
-    	prs_error("Garbage deleted");
-        while (! eol_seen) yylex();	 /* skip rest of line */
-    }
+static int
+checkeol(struct t2mf *t) {
+    if (t->eol_seen || t->stopped) return(0);
+    if (yylex(t) != EOL)
+    	return prs_error(t, "Garbage deleted");
+    return(0);
 }
 
+/* checkeol(), then skip whatever of a long line prs_error() left */
 static void
-gethex(void) {
+finishline(struct t2mf *t) {
+    if (checkeol(t))
+        while (! t->eol_seen && yylex(t) != EOF)
+            ;
+}
+
+static int
+gethex(struct t2mf *t) {
     int c;
     unsigned int u;
-    buflen = 0;
-    do_hex = 1;
-    c = yylex();
+    t->buflen = 0;
+    t->do_hex = 1;
+    c = yylex(t);
     if (c == STRING) {
         /* Note: yytext includes the trailing, but not the starting quote */
-        size_t i = 0;
-	size_t tsize = gyyleng() - 1;
-    	if (tsize > bufsiz) {
-            bufsiz = tsize;
-	    buffer = realloc(buffer, bufsiz);
-            if (!buffer)
-		error("string buffer realloc failed");
+        size_t i = 0, k;
+	size_t tsize = t->yyleng - 1;
+    	if (tsize > t->bufsiz) {
+            t->bufsiz = tsize;
+	    t->buffer = realloc(t->buffer, t->bufsiz);
+            if (!t->buffer)
+		error(t, "string buffer realloc failed");
+	    GROWN(t);
         }
         while (i < tsize) {
-            c = yytext[i++];
+            c = t->yytext[i++];
 rescan:
             if (c == '\\') {
-                switch (c = yytext[i++]) {
+                switch (c = t->yytext[i++]) {
 		case '0':
 		    c = '\0';
 		    break;
@@ -251,42 +353,62 @@ rescan:
 		    c = '\t';
 		    break;
 		case 'x':
-		    if (sscanf(yytext+i, "%2x", &u) != 1)
-			prs_error("Illegal \\x in string");
+		    u = 0;
+		    for (k = i; k < i+2 && isxdigit((unsigned char)t->yytext[k]); k++)
+			u = u*16 + (isdigit((unsigned char)t->yytext[k]) ?
+			    t->yytext[k]-'0' : tolower((unsigned char)t->yytext[k])-'a'+10);
+		    if (k == i)
+			return prs_error(t, "Illegal \\x in string");
 		    c = u;
 		    i += 2;
 		    break;
 		case '\r':
 		case '\n':
-		    while ((c=yytext[i++]) == ' ' || c == '\t' ||
+		    while ((c=t->yytext[i++]) == ' ' || c == '\t' ||
 			   c == '\r' || c == '\n')
 			/* skip whitespace */;
 		    goto rescan; /* sorry EWD :=) */
                 }
             }
-            buffer[buflen++] = c;
+            t->buffer[t->buflen++] = c;
         }	    
     } else if (c == INT) {
         do {
-    	    if (buflen >= bufsiz) {
-                bufsiz += 128;
-		buffer = realloc(buffer, bufsiz);
-                if (!buffer)
-		    error("int buffer realloc failed");
+    	    if (t->buflen >= t->bufsiz) {
+                t->bufsiz += 128;
+		t->buffer = realloc(t->buffer, t->bufsiz);
+                if (!t->buffer)
+		    error(t, "int buffer realloc failed");
+		GROWN(t);
             }
 /* This test not applicable for sysex
-            if (yyval < 0 || yyval > 127)
-                error("Illegal hex value"); */
-            buffer[buflen++] = yyval;
-            c = yylex();
+            if (t->yyval < 0 || t->yyval > 127)
+                error(t, "Illegal hex value"); */
+            t->buffer[t->buflen++] = t->yyval;
+            c = yylex(t);
         } while (c == INT);
-        if (c != EOL) prs_error("Unknown hex input");
+        if (c != EOL) return prs_error(t, "Unknown hex input");
     }
-    else prs_error("String or hex input expected");
+    else return prs_error(t, "String or hex input expected");
+    return(0);
+}
+
+/* put c in front of the bytes from gethex() */
+static void
+prefix(struct t2mf *t, int c) {
+    if (t->buflen >= t->bufsiz) {
+        t->bufsiz += 128;
+        t->buffer = realloc(t->buffer, t->bufsiz);
+        if (!t->buffer)
+            error(t, "int buffer realloc failed");
+        GROWN(t);
+    }
+    memmove(t->buffer + 1, t->buffer, t->buflen++);
+    t->buffer[0] = c;
 }
 
 bankno_t
-bankno(char *s, int n) {		/* used by t2mflex */
+bankno(char *s, int n) {		/* used by t2mfscan.c */
     bankno_t res = 0;
     int c;
     while (n-- > 0) {
@@ -303,140 +425,164 @@ bankno(char *s, int n) {		/* used by t2mflex */
 }
 
 static void
-mywritetrack(void) {
+mywritetrack(struct mf_writer *w) {
+    struct t2mf *t = w->data;
     int opcode, c;
-    volatile mf_deltat_t currtime = 0;
+    mf_deltat_t currtime = 0;
     mf_deltat_t newtime, delta;
     int i, k;
  
-    while ((opcode = yylex()) == EOL)
+    while ((opcode = yylex(t)) == EOL)
 	;
     if (opcode != MTRK)
-        prs_error("Missing MTrk");
-    checkeol();
+        prs_error(t, "Missing MTrk");
+    finishline(t);
+    /* a parse error skips the line, and we go on with the next */
     while (1) {
-        err_cont = 1;
-        setjmp(erjump);
-        switch (yylex()) {
+        if (t->quiet && t->errors)
+            return;			/* the track will be done again */
+        if (t->stopped)
+            return;
+        switch (yylex(t)) {
             case MTRK:
-                prs_error("Unexpected MTrk");
-		return;			/* PLB */
+                prs_error(t, "Unexpected MTrk");
+		continue;
             case EOF:
-                err_cont = 0;
-                error("Unexpected EOF");
+                error(t, "Unexpected EOF");
                 return;
             case TRKEND:
-                err_cont = 0;
-                checkeol();
+                finishline(t);
                 return;
             case INT:
-                newtime = yyval;
-                if ((opcode = yylex()) == '/') {
-                    if (yylex() != INT)
-			prs_error("Illegal time value");
-                    newtime = (newtime-M0)*Measure+yyval;
-                    if (yylex() != '/' || yylex() != INT)
-                        prs_error("Illegal time value");
-                    newtime = T0 + newtime*Beat + yyval;
-                    opcode = yylex();
+                newtime = t->yyval;
+                if ((opcode = yylex(t)) == '/') {
+                    t->usedtime = 1;
+                    if (yylex(t) != INT) {
+			prs_error(t, "Illegal time value");
+			continue;
+		    }
+                    newtime = (newtime-t->m0)*t->measure+t->yyval;
+                    if (yylex(t) != '/' || yylex(t) != INT) {
+                        prs_error(t, "Illegal time value");
+			continue;
+		    }
+                    newtime = t->t0 + newtime*t->beat + t->yyval;
+                    opcode = yylex(t);
                 }
                 delta = newtime - currtime;
                 switch (opcode) {
 		case ON:
 		case OFF:
 		case POPR:
-		    checkchan();
-		    checknote();
-		    checkval();
-		    mf_w_midi_event(delta, opcode, chan,
-				    (unsigned char *)data, 2L);
+		    if (checkchan(t) || checknote(t) || checkval(t))
+			continue;
+		    mf_w_midi_event_r(t->w, delta, opcode, t->chan,
+				    (unsigned char *)t->data, 2L);
 		    break;
 
 		case PAR:
-		    checkchan();
-		    checkcon();
-		    checkval();
-		    mf_w_midi_event(delta, opcode, chan,
-				    (unsigned char *)data, 2L);
+		    if (checkchan(t) || checkcon(t) || checkval(t))
+			continue;
+		    mf_w_midi_event_r(t->w, delta, opcode, t->chan,
+				    (unsigned char *)t->data, 2L);
 		    break;
 		
 		case PB:
-		    checkchan();
-		    splitval();
-		    mf_w_midi_event(delta, opcode, chan,
-				    (unsigned char *)data, 2L);
+		    if (checkchan(t) || splitval(t))
+			continue;
+		    mf_w_midi_event_r(t->w, delta, opcode, t->chan,
+				    (unsigned char *)t->data, 2L);
 		    break;
 
 		case PRCH:
-		    checkchan();
-		    checkprog();
-		    mf_w_midi_event(delta, opcode, chan,
-				    (unsigned char *)data, 1L);
+		    if (checkchan(t) || checkprog(t))
+			continue;
+		    mf_w_midi_event_r(t->w, delta, opcode, t->chan,
+				    (unsigned char *)t->data, 1L);
 		    break;
  
 		case CHPR:
-		    checkchan();
-		    checkval();
-		    data[0] = data[1];
-		    mf_w_midi_event(delta, opcode, chan,
-				    (unsigned char *)data, 1L);
+		    if (checkchan(t) || checkval(t))
+			continue;
+		    t->data[0] = t->data[1];
+		    mf_w_midi_event_r(t->w, delta, opcode, t->chan,
+				    (unsigned char *)t->data, 1L);
 		    break;
  
 		case SYSEX:
+		    if (gethex(t))
+			continue;
+		    mf_w_sysex_event_r(t->w, delta, t->buffer, t->buflen);
+		    break;
+
 		case ARB:
-		    gethex();
-		    mf_w_sysex_event(delta, buffer, buflen);
+		    if (gethex(t))
+			continue;
+		    prefix(t, 0xf7);	/* mf2t leaves it out */
+		    mf_w_sysex_event_r(t->w, delta, t->buffer, t->buflen);
 		    break;
 
 		case TEMPO:
-		    if (yylex() != INT) syntax();
-		    mf_w_tempo(delta, yyval);
+		    if (yylex(t) != INT) {
+			syntax(t);
+			continue;
+		    }
+		    mf_w_tempo_r(t->w, delta, t->yyval);
 		    break;
 
 		case TIMESIG: {
 		    int nn, denom, cc, bb;
-		    if (yylex() != INT || yylex() != '/') syntax();
-		    nn = yyval;
-		    denom = getbyte("Denom");
-		    cc = getbyte("clocks per click");
-		    bb = getbyte("32nd notes per 24 clocks");
+		    t->usedtime = t->settime = 1;
+		    if (yylex(t) != INT || yylex(t) != '/') {
+			syntax(t);
+			continue;
+		    }
+		    nn = t->yyval;
+		    denom = getbyte(t, "Denom");
+		    cc = getbyte(t, "clocks per click");
+		    bb = getbyte(t, "32nd notes per 24 clocks");
 		    for (i = 0, k = 1 ; k < denom; i++, k <<= 1);
-		    if (k != denom) error ("Illegal TimeSig");
-		    data[0] = nn;
-		    data[1] = i;
-		    data[2] = cc;
-		    data[3] = bb;
-		    M0 += (newtime-T0)/(Beat*Measure);
-		    T0 = newtime;
-		    Measure = nn;
-		    Beat = 4 * Clicks / denom;
-		    mf_w_meta_event(delta, time_signature, data, 4);
+		    if (k != denom) error(t, "Illegal TimeSig");
+		    t->data[0] = nn;
+		    t->data[1] = i;
+		    t->data[2] = cc;
+		    t->data[3] = bb;
+		    if (t->beat*t->measure != 0)	/* not after 0/n or n/0 */
+			t->m0 += (newtime-t->t0)/(t->beat*t->measure);
+		    t->t0 = newtime;
+		    t->measure = nn;
+		    if (denom != 0)
+			t->beat = 4 * t->clicks / denom;
+		    mf_w_meta_event_r(t->w, delta, time_signature, t->data, 4);
 		    break;
 		}
 
 		case SMPTE:
 		    for (i=0; i<5; i++)
-			data[i] = getbyte("SMPTE");
-		    mf_w_meta_event(delta, smpte_offset, data, 5);
+			t->data[i] = getbyte(t, "SMPTE");
+		    mf_w_meta_event_r(t->w, delta, smpte_offset, t->data, 5);
 		    break;
 
 		case KEYSIG:
-		    data[0] = i = getint ("Keysig");
+		    t->data[0] = i = getint(t, "Keysig");
 		    if (i < -7 || i > 7)
-			error("Key Sig must be between -7 and 7");
-		    if ((c = yylex()) != MINOR && c != MAJOR)
-			syntax();
-		    data[1] = (c == MINOR);
-		    mf_w_meta_event(delta, key_signature, data, 2);
+			error(t, "Key Sig must be between -7 and 7");
+		    if ((c = yylex(t)) != MINOR && c != MAJOR) {
+			syntax(t);
+			continue;
+		    }
+		    t->data[1] = (c == MINOR);
+		    mf_w_meta_event_r(t->w, delta, key_signature, t->data, 2);
 		    break;
 
 		case SEQNR:
-		    get16val();
-		    mf_w_meta_event(delta, sequence_number, data, 2);
+		    if (get16val(t))
+			continue;
+		    mf_w_meta_event_r(t->w, delta, sequence_number, t->data, 2);
 		    break;
 
 		case META: {
-		    int type = yylex();
+		    int type = yylex(t);
 		    switch (type) {
 		    case TRKEND:
 			type = end_of_track;
@@ -451,67 +597,473 @@ mywritetrack(void) {
 			type -= (META+1);
 			break;
 		    case INT:
-			type = yyval;
+			type = t->yyval;
 			break;
 		    default:
-			prs_error("Illegal Meta type");
+			prs_error(t, "Illegal Meta type");
+			continue;
 		    }
 		    if (type == end_of_track)
-			buflen = 0;
-		    else
-			gethex();
-		    mf_w_meta_event(delta, type, buffer, buflen);
+			t->buflen = 0;
+		    else if (gethex(t))
+			continue;
+		    mf_w_meta_event_r(t->w, delta, type, t->buffer, t->buflen);
 		    break;
 		}
 
 		case SEQSPEC:
-		    gethex();
-		    mf_w_meta_event(delta, sequencer_specific, buffer, buflen);
+		    if (gethex(t))
+			continue;
+		    mf_w_meta_event_r(t->w, delta, sequencer_specific, t->buffer, t->buflen);
 		    break;
 
 		default:
-		    prs_error("Unknown input");
-		    break;
+		    prs_error(t, "Unknown input");
+		    continue;
                 }
                 currtime = newtime;
 	case EOL:
 	    break;
 	default:
-	    prs_error("Unknown input");
-	    break;
+	    prs_error(t, "Unknown input");
+	    continue;
         }
-        checkeol();
+        checkeol(t);
     }
 } // mywritetrack
 
+#if _POSIX_C_SOURCE >= 2
+/*
+ * Parallel translation (see partrack.h).  The text is cut before each
+ * line that starts with MTrk, and each piece is translated into a
+ * track chunk of its own, which is written out in order.  A piece
+ * can’t be done cleanly if it has an error or anything but empty lines
+ * after its TrkEnd; nor can one that uses the bar:beat:click state
+ * after an earlier track changed it with TimeSig, which is only found
+ * as they are written out.  With -S, Counts[i] is what piece i’s
+ * writer counted.
+ */
+
+struct track {
+    unsigned char *text;	/* the piece of text */
+    unsigned char *end;
+    mf_data_t *chunk;		/* the MTrk chunk for it */
+    mf_size_t len;
+    int lines;			/* lines in the piece */
+    int measure, m0, beat;	/* the bar:beat:click state after it */
+    mf_ticks_t t0;
+    int usedtime, settime;
+};
+
+/* a worker’s writer and hex buffer, kept from one piece to the next */
+struct trackwriter {
+    struct mf_writer w;
+    struct t2mf t;
+    mf_data_t *buffer;
+    mf_size_t bufsiz;
+};
+
+static struct track *Tracks;
+static int NTracks;
+static struct t2mf Start;	/* state before the first track */
+static struct mf_stats *Counts;	/* -S: for each track */
+
+/* translate piece i into its chunk; 0 if that can’t be done cleanly */
+static int
+dotrack(void **state, int i) {
+    struct trackwriter *tw = *state;
+    struct track *trk = &Tracks[i];
+    struct t2mf *t;
+    int c, done;
+
+    if (tw == NULL) {
+        if ((tw = *state = malloc(sizeof(*tw))) == NULL)
+            return(0);
+        mf_writer_init(&tw->w);
+        tw->w.Mf_putbuf = myputbuf;
+        tw->w.Mf_wtrack = mywritetrack;
+        tw->w.runstat = Start.w->runstat;
+        tw->w.noexit = 1;
+        tw->w.data = &tw->t;
+        tw->buffer = NULL;
+        tw->bufsiz = 0;
+    }
+    t = &tw->t;
+    *t = Start;
+    t->cur = trk->text;
+    t->end = trk->end;
+    t->lineno = 1;
+    t->w = &tw->w;
+    t->out = NULL;
+    t->outbuf = NULL;
+    t->outleng = t->outsize = 0;
+    t->usedtime = t->settime = 0;
+    t->quiet = 1;
+    t->errors = 0;
+    t->buffer = tw->buffer;
+    t->bufsiz = tw->bufsiz;
+    tw->w.stats = Counts ? &Counts[i] : NULL;
+    done = writetrack(t, i) == 0;
+    while (done && (c = yylex(t)) == EOL)
+        ;
+    if (done && c == EOF && t->errors == 0) {
+        trk->chunk = t->outbuf;
+        trk->len = t->outleng;
+        trk->lines = t->lineno - 1;
+        trk->measure = t->measure;
+        trk->m0 = t->m0;
+        trk->beat = t->beat;
+        trk->t0 = t->t0;
+        trk->usedtime = t->usedtime;
+        trk->settime = t->settime;
+    } else {
+        free(t->outbuf);
+        mf_writer_free(&tw->w);	/* it may hold part of a chunk */
+        done = 0;
+    }
+    tw->buffer = t->buffer;
+    tw->bufsiz = t->bufsiz;
+    return(done);
+}
+
+static void
+freetrackwriter(void *state) {
+    struct trackwriter *tw = state;
+
+    free(tw->buffer);
+    mf_writer_free(&tw->w);
+    free(tw);
+}
+
+/* add the piece of text from p to end as a track */
+static int
+addtrack(unsigned char *p, unsigned char *end) {
+    struct track *more;
+
+    if ((NTracks & (NTracks - 1)) == 0) {
+        more = realloc(Tracks, (NTracks ? 2*NTracks : 1) * sizeof(*more));
+        if (more == NULL)
+            return(-1);
+        Tracks = more;
+    }
+    Tracks[NTracks].text = p;
+    Tracks[NTracks].end = end;
+    Tracks[NTracks].chunk = NULL;
+    NTracks++;
+    return(0);
+}
+
+/* does the line at p start with MTrk? */
+static int
+ismtrk(const unsigned char *p, const unsigned char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return(end - p >= 4 && tolower(p[0]) == 'm' && tolower(p[1]) == 't' &&
+            tolower(p[2]) == 'r' && tolower(p[3]) == 'k' &&
+            (end - p == 4 || !isalpha(p[4])));
+}
+
+/*
+ * Translate as many of the tracks as can be done in parallel and write
+ * them out; return the number done, leaving t at the text after them.
+ */
+static int
+partracks(struct t2mf *t) {
+    unsigned char *p, *q, *start = t->cur;
+    int i, seen = 0, changed = 0, done = 0;
+
+    Tracks = NULL;
+    NTracks = 0;
+    for (p = t->cur; p < t->end && NTracks < t->ntrks; p = q) {
+        if (ismtrk(p, t->end) && seen++) {
+            if (addtrack(start, p) < 0)
+                break;
+            start = p;
+        }
+        q = memchr(p, '\n', t->end - p);
+        q = q ? q + 1 : t->end;
+    }
+    if (p == t->end && seen && NTracks < t->ntrks)
+        addtrack(start, p);
+
+    /* workers fill in the counts for their tracks, but can’t make room */
+    Counts = NULL;
+    if (t->st && NTracks > 0 && (stats_track(t->st, NTracks - 1) == NULL ||
+            (Counts = calloc(NTracks, sizeof(*Counts))) == NULL)) {
+        free(Tracks);
+        return(0);
+    }
+    Start = *t;
+    if (partrack_run(NTracks, jobs, dotrack, freetrackwriter) < 0) {
+        free(Counts);
+        free(Tracks);
+        return(0);
+    }
+
+    for (i = 0; i < NTracks && partrack_wait(i); i++) {
+        struct track *trk = &Tracks[i];
+
+        if (changed && trk->usedtime)
+            break;
+        if (myputbuf(t->w, trk->chunk, trk->len) != (int)trk->len)
+            exit(1);			/* as the library does */
+        if (Counts)
+            mf_stats_add(&t->st->lib, &Counts[i]);
+        if (trk->settime) {
+            t->measure = trk->measure;
+            t->m0 = trk->m0;
+            t->beat = trk->beat;
+            t->t0 = trk->t0;
+            changed = 1;
+        }
+        t->cur = trk->end;
+        t->lineno += trk->lines;
+        done++;
+    }
+
+    partrack_end();
+    for (i = 0; i < NTracks; i++)
+        free(Tracks[i].chunk);
+    free(Tracks);
+    free(Counts);
+    return(done);
+}
+#endif
+
+/* get t ready for a new file, keeping its buffers */
+static void
+newfile(struct t2mf *t, FILE *in, FILE *out) {
+    t->in = in;
+    t->out = out;
+    t->state = 0;
+    t->do_hex = 0;
+    t->eol_seen = 0;
+    t->lineno = 1;
+    t->measure = 4;
+    t->beat = 96;
+    t->clicks = 96;
+    t->m0 = 0;
+    t->t0 = 0;
+    t->errors = 0;
+    t->stopped = 0;
+}
+
+#ifdef MFCHECK
+mf_data_t *
+t2mf_midi(const char *name, const char *text, size_t leng, int runstat,
+        mf_size_t *lengp) {
+    struct mf_writer w;
+    struct t2mf t;
+    int status;
+
+    mf_writer_init(&w);
+    w.Mf_putbuf = myputbuf;
+    w.Mf_wtrack = mywritetrack;
+    w.runstat = runstat;
+    w.noexit = 1;
+    w.data = &t;
+    memset(&t, 0, sizeof(t));
+    t.w = &w;
+    newfile(&t, NULL, NULL);	/* keep the output in t.outbuf */
+    t.name = name;
+    t.cur = (unsigned char *)text;
+    t.end = t.cur + leng;
+    status = translate(&t);
+    yyunload(&t);
+    free(t.buffer);
+    mf_writer_free(&w);
+    if (status < 0) {
+        free(t.outbuf);
+        return(NULL);
+    }
+    *lengp = t.outleng;
+    return(t.outbuf);
+}
+#else
+
+/* start counting for -S in st */
 static void
-initfuncs(void) {
-    Mf_putc = putchar;
-    Mf_wtrack = mywritetrack;
+newstats(struct t2mf *t, struct stats *st) {
+    stats_begin(st);
+    t->st = st;
+    t->w->stats = &st->lib;
+}
+
+/* write what -S counted for the file name; translating includes encoding */
+static void
+report(struct t2mf *t, const char *name, int status) {
+    stats_report(Statsfp, name, t->st, "translate", t->textleng,
+            t->st->lib.bytes, status);
+}
+
+/*
+ * Batch mode.  The text files named on the command line (all the .txt
+ * files, for a directory) and in a list file are each translated to a
+ * .mid file of the same name, next to it or in outdir.  Worker threads
+ * each take a file at a time, keeping their writer, input and hex
+ * buffers from one to the next.  A file with errors is reported, and
+ * the rest are still done.
+ */
+
+/* the .mid file for name */
+static char *
+midname(const char *name) {
+    const char *base = name, *p, *dot = NULL;
+    size_t dirleng = 0;
+    char *mid;
+
+    for (p = name; *p; p++)
+        if (*p == '/')
+            base = p + 1, dot = NULL;
+        else if (*p == '.')
+            dot = p;
+    if (dot == NULL || dot == base)
+        dot = p;
+    if (outdir) {
+        dirleng = strlen(outdir) + 1;
+        name = base;
+    }
+    if ((mid = malloc(dirleng + (dot - name) + 5)) == NULL)
+        return(NULL);
+    if (outdir)
+        sprintf(mid, "%s/", outdir);
+    sprintf(mid + dirleng, "%.*s.mid", (int)(dot - name), name);
+    return(mid);
+}
+
+/* translate one file; -1 if that failed */
+static int
+convert(struct t2mf *t, const char *name) {
+    char *mid;
+    FILE *in, *out;
+    int status;
+
+    if ((mid = midname(name)) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return(-1);
+    }
+    if (strcmp(mid, name) == 0) {
+        fprintf(stderr, "%s: would be overwritten\n", name);
+        free(mid);
+        return(-1);
+    }
+    if ((in = fopen(name, "r")) == NULL) {
+        perror(name);
+        free(mid);
+        return(-1);
+    }
+    if ((out = fopen(mid, "wb")) == NULL) {
+        perror(mid);
+        fclose(in);
+        free(mid);
+        return(-1);
+    }
+    newfile(t, in, out);
+    t->name = name;
+    if ((status = translate(t)) < 0)
+        mf_writer_free(t->w);	/* it may hold part of a chunk */
+    yyunload(t);
+    if (ferror(out) | (fclose(out) != 0)) {
+        perror(mid);
+        status = -1;
+    }
+    if (t->st)
+        report(t, name, status);
+    fclose(in);
+    free(mid);
+    return(status);
+}
+
+/* translate files until there are none left, counting failures in *arg */
+static void *
+batchworker(void *arg) {
+    int *failures = arg;
+    struct mf_writer w;
+    struct t2mf t;
+    struct stats st;
+    const char *name;
+
+    mf_writer_init(&w);
+    w.Mf_putbuf = myputbuf;
+    w.Mf_wtrack = mywritetrack;
+    w.runstat = runstat;
+    w.noexit = 1;
+    w.data = &t;
+    memset(&t, 0, sizeof(t));
+    t.w = &w;
+    memset(&st, 0, sizeof(st));
+    while ((name = batch_next()) != NULL) {
+        if (Statsfp)
+            newstats(&t, &st);
+        if (convert(&t, name) < 0)
+            ++*failures;
+    }
+    stats_free(&st);
+    free(t.inbuf);
+    free(t.buffer);
+    mf_writer_free(&w);
+    return(NULL);
 }
 
 static void
 usage(void) {
     fprintf(stderr,
 "t2mf v%s\n"
-"Usage: t2mf [Options] [textfile [midifile]]\n\n"
+"Usage: t2mf [Options] [textfile [midifile]]\n"
+"       t2mf -B [-o dir] [-l list] [Options] [textfile|dir...]\n\n"
 "Options:\n"
 "  -d      debug output\n"
-"  -r      use running status\n", VERSION);
+"  -r      use running status\n"
+"  -j n    translate up to n tracks (files) at once (default: one per CPU)\n"
+"  -B      batch mode: write each textfile’s MIDI file to a .mid file\n"
+"  -o dir  put the .mid files in dir (implies -B)\n"
+"  -l list also translate the files named in list, one per line (-B)\n"
+"  -S file write statistics for each textfile to file (- for stderr)\n",
+	VERSION);
     exit(1);
 }
 
 int
 main(int argc, char **argv) {
-    int c;
+    struct mf_writer w;
+    struct t2mf t;
+    struct stats st;
+    const char *list = NULL, *name = "-";
+    int c, status;
 
-    while ((c = getopt(argc, argv, "rh")) != -1) {
+#if _POSIX_C_SOURCE >= 2 && defined(_SC_NPROCESSORS_ONLN)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    mf_writer_init(&w);
+    while ((c = getopt(argc, argv, "rj:Bo:l:S:h")) != -1) {
         switch (c) {
 	case 'r':
-	    Mf_RunStat = 1;
+	    w.runstat = runstat = 1;
 	    break;
 	case 'd':
-	    Mf_trace_output = 1;
+	    w.trace_output = 1;
+	    break;
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 'B':
+	    batch = 1;
+	    break;
+	case 'o':
+	    outdir = optarg;
+	    batch = 1;
+	    break;
+	case 'l':
+	    list = optarg;
+	    batch = 1;
+	    break;
+	case 'S':
+	    if (strcmp(optarg, "-") == 0)
+		Statsfp = stderr;
+	    else if ((Statsfp = fopen(optarg, "w")) == NULL) {
+		perror(optarg);
+		exit(1);
+	    }
 	    break;
 	case 'h':
 	case '?':
@@ -520,25 +1072,39 @@ main(int argc, char **argv) {
         }
     }
 
-    if (optind < argc && !freopen(argv[optind++], "r", stdin)) {
+    if (batch) {
+        if (list)
+            batch_addlist(list, batch_istext);
+        while (optind < argc)
+            batch_addarg(argv[optind++], batch_istext);
+        return(batch_run(jobs, batchworker) ? 1 : 0);
+    }
+
+    if (optind < argc && !freopen(name = argv[optind++], "r", stdin)) {
         perror(argv[optind - 1]);
         exit(1);
     }
-    yyin = stdin;
 
     if (optind < argc && !freopen(argv[optind], "w", stdout)) {
 	perror(argv[optind]);
         exit(1);
     }
 
-    initfuncs();
+    memset(&t, 0, sizeof(t));
+    w.Mf_putbuf = myputbuf;
+    w.Mf_wtrack = mywritetrack;
+    w.data = &t;
+    t.w = &w;
+    newfile(&t, stdin, stdout);
     TrkNr = 0;
-    Measure = 4;
-    Beat = 96;
-    Clicks = 96;
-    M0 = 0;
-    T0 = 0;
-    translate();
+    if (Statsfp) {
+        memset(&st, 0, sizeof(st));
+        newstats(&t, &st);
+    }
+    status = translate(&t);
+    if (Statsfp)
+        report(&t, name, status);
 
     return 0;
 }
+#endif
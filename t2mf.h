@@ -2,6 +2,7 @@
 #define T2MF_H
 
 /* $Id: t2mf.h,v 1.2 1991/11/03 21:50:50 piet Rel $ */
+
 #include "midifile.h"
 
 #define MTHD	256
@@ -49,22 +50,58 @@
 #define TIMESIG	(META+1+time_signature)
 #define SMPTE	(META+1+smpte_offset)
 
-extern int yywrap(void);
-extern void error(const char *);
+/*
+ * Everything needed to translate a stretch of text: the scanner’s
+ * state and the parser’s.  Tracks translated in parallel each have
+ * their own.
+ */
+struct t2mf {
+    /* t2mfscan.c */
+    unsigned char *cur;		/* next character to scan */
+    unsigned char *end;		/* end of the input */
+    int state;			/* start condition */
+    int do_hex;			/* scan hex bytes next */
+    int eol_seen;
+    int lineno;
+    int32_t yyval;
+    char *yytext;		/* the token, in the input */
+    size_t yyleng;
+    unsigned char *map;		/* the input, if it is mapped */
+    size_t mapsize;
+    unsigned char *inbuf;	/* else read into here, kept for the next */
+    size_t insize;
 
-typedef int32_t bankno_t;
-bankno_t bankno(char *s, int n);
+    /* t2mf.c */
+    struct mf_writer *w;
+    FILE *in;			/* the text */
+    const char *name;		/* and its name, in batch mode */
+    FILE *out;			/* NULL: keep the output in outbuf */
+    mf_data_t *outbuf;
+    mf_size_t outleng, outsize;
+    int ntrks, clicks;		/* from the MFile line */
+    int measure, m0, beat;	/* for bar:beat:click times */
+    mf_ticks_t t0;
+    int usedtime;		/* the above were needed */
+    int settime;		/* and were changed */
+    mf_data_t data[5];
+    int chan;
+    mf_data_t *buffer;		/* hex or string data */
+    mf_size_t bufsiz, buflen;
+    int quiet;			/* a parallel track: don’t report errors */
+    int errors;			/* count of them */
+    int stopped;		/* EOF after an error in batch mode: give up */
+    size_t textleng;		/* bytes of text, for -S */
+    struct stats *st;		/* -S: what is counted for the file */
+};
 
-extern int32_t yyval;
+extern void error(struct t2mf *t, const char *);
 
-extern size_t gyyleng(void);
+typedef int32_t bankno_t;
+bankno_t bankno(char *s, int n);
 
-/* from (f)lex template: */
-extern int yylex(void);
-extern int lineno;
-extern char *yytext;
-extern int do_hex;
-extern int eol_seen;
-extern FILE *yyin;
+/* from t2mfscan.c: */
+extern int yyload(struct t2mf *t, FILE *f);
+extern void yyunload(struct t2mf *t);
+extern int yylex(struct t2mf *t);
 #endif
 
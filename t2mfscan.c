@@ -0,0 +1,363 @@
+/*
+ * t2mfscan.c
+ *
+ * The t2mf scanner.  This used to be generated by flex from t2mf.fl;
+ * it is now written out by hand and works on the whole input held in
+ * memory (mapped, when it is a regular file), so yytext points into
+ * the input instead of at a copy, and numbers are converted as they
+ * are scanned rather than by sscanf.
+ *
+ * The tokens are those t2mf.fl gave: keywords are case insensitive,
+ * the longest match wins and, of two equally long, the keyword wins
+ * over an unknown word.  The yytext of a string runs from just after
+ * the opening quote up to and including the closing one.  All of the
+ * scanner’s state is in the struct t2mf, so separate stretches of the
+ * input can be scanned at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if _POSIX_C_SOURCE >= 2
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+
+#include "t2mf.h"
+
+enum { INITIAL, HEX, QUOTE };		/* start conditions */
+
+#define ISALPHA(c)	((unsigned)(((c) | 0x20) - 'a') < 26)
+#define ISDIGIT(c)	((unsigned)((c) - '0') < 10)
+
+static const struct keyword {
+    const char *name;			/* in lower case */
+    size_t leng;
+    int token;
+} keywords[] = {
+#define KW(NAME, TOKEN) { NAME, sizeof(NAME) - 1, TOKEN }
+    KW("on", ON),
+    KW("off", OFF),
+    KW("ch=", CH),
+    KW("n=", NOTE),
+    KW("v=", VAL),
+    KW("c=", CON),
+    KW("p=", PROG),
+    KW("par", PAR),
+    KW("pb", PB),
+    KW("prch", PRCH),
+    KW("chpr", CHPR),
+    KW("popr", POPR),
+    KW("mfile", MTHD),
+    KW("mtrk", MTRK),
+    KW("trkend", TRKEND),
+    KW("polypr", POPR),
+    KW("param", PAR),
+    KW("progch", PRCH),
+    KW("chanpr", CHPR),
+    KW("sysex", SYSEX),
+    KW("meta", META),
+    KW("seqspec", SEQSPEC),
+    KW("text", TEXT),
+    KW("copyright", COPYRIGHT),
+    KW("trkname", SEQNAME),
+    KW("seqname", SEQNAME),
+    KW("instrname", INSTRNAME),
+    KW("lyric", LYRIC),
+    KW("marker", MARKER),
+    KW("cue", CUE),
+    KW("seqnr", SEQNR),
+    KW("keysig", KEYSIG),
+    KW("tempo", TEMPO),
+    KW("timesig", TIMESIG),
+    KW("smpte", SMPTE),
+    KW("arb", ARB),
+    KW("minor", MINOR),
+    KW("major", MAJOR),
+    KW("note=", NOTE),
+    KW("vol=", VAL),
+    KW("val=", VAL),
+    KW("con=", CON),
+    KW("prog=", PROG),
+#undef KW
+};
+
+#define NKEYWORDS (sizeof(keywords)/sizeof(keywords[0]))
+#define MAXKEYWORD 10			/* longest keyword, with its = */
+
+static int
+hexval(int c) {
+    if (ISDIGIT(c))
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* the leng characters at p are the next token */
+static int
+token(struct t2mf *t, unsigned char *p, size_t leng, int tok) {
+    t->yytext = (char *)p;
+    t->yyleng = leng;
+    t->cur = p + leng;
+    return tok;
+}
+
+static int
+lookup(const char *word, size_t leng) {
+    const struct keyword *k;
+
+    for (k = keywords; k < keywords + NKEYWORDS; k++)
+        if (k->leng == leng && memcmp(k->name, word, leng) == 0)
+            return k->token;
+    return ERR;
+}
+
+/* [-+]?[0-9]+ or 0x{Hex}+ */
+static int
+number(struct t2mf *t, unsigned char *p) {
+    unsigned char *q = p;
+    uint32_t u = 0;
+    int h;
+
+    if (p[0] == '0' && t->end - p > 2 && (p[1] | 0x20) == 'x' &&
+            hexval(p[2]) >= 0) {
+        for (q = p + 2; q < t->end && (h = hexval(*q)) >= 0; q++)
+            u = u << 4 | h;
+    } else {
+        if (*q == '-' || *q == '+')
+            q++;
+        for (; q < t->end && ISDIGIT(*q); q++)
+            u = u * 10 + (*q - '0');
+        if (*p == '-')
+            u = -u;
+    }
+    t->yyval = (int32_t)u;
+    return token(t, p, q - p, INT);
+}
+
+/* a keyword, a note, or an unknown word */
+static int
+word(struct t2mf *t, unsigned char *p) {
+    char lower[MAXKEYWORD + 1];
+    unsigned char *q;
+    size_t leng, i;
+    int c;
+
+    for (q = p; q < t->end && ISALPHA(*q); q++)
+        ;
+    leng = q - p;
+
+    /* [a-g][#b+-]?[0-9]+, which always outruns the word */
+    c = *p | 0x20;
+    if (c >= 'a' && c <= 'g') {
+        q = p + 1;
+        if (q < t->end && (*q == '#' || (*q | 0x20) == 'b' ||
+                *q == '+' || *q == '-'))
+            q++;
+        if (q < t->end && ISDIGIT(*q)) {
+            uint32_t u = 0;
+
+            for (; q < t->end && ISDIGIT(*q); q++)
+                u = u * 10 + (*q - '0');
+            t->yyval = (int32_t)u;		/* the octave */
+            return token(t, p, q - p, NOTEVAL);
+        }
+    }
+
+    if (leng < MAXKEYWORD) {
+        for (i = 0; i < leng; i++)
+            lower[i] = p[i] | 0x20;
+        if (p + leng < t->end && p[leng] == '=') {
+            lower[leng] = '=';
+            if ((c = lookup(lower, leng + 1)) != ERR)
+                return token(t, p, leng + 1, c);
+        }
+        return token(t, p, leng, lookup(lower, leng));
+    }
+    return token(t, p, leng, ERR);
+}
+
+/* a string; p is just after the opening quote */
+static int
+quoted(struct t2mf *t, unsigned char *p) {
+    unsigned char *q = p;
+
+    t->state = QUOTE;
+    while (q < t->end) {
+        switch (*q++) {
+        case '"':
+            t->state = INITIAL;
+            return token(t, p, q - p, STRING);
+        case '\\':
+            if (q < t->end)
+                q++;
+            break;
+        case '\n':
+            error(t, "unterminated string");
+            t->lineno++;
+            t->eol_seen++;
+            t->state = INITIAL;
+            return token(t, p, q - p, EOL);
+        }
+    }
+    error(t, "EOF in string");
+    return token(t, t->end, 0, EOF);
+}
+
+int
+yylex(struct t2mf *t) {
+    unsigned char *p, *q;
+    int c, h;
+
+    if (t->do_hex) {
+        t->state = HEX;
+        t->do_hex = 0;
+    }
+    t->eol_seen = 0;
+
+    if (t->state == QUOTE)
+        return quoted(t, t->cur);
+
+    for (p = t->cur; p < t->end; p++) {
+        switch (*p) {
+        case ' ':
+        case '\t':
+        case '\r':
+            continue;
+        case '\n':
+            t->lineno++;
+            t->eol_seen++;
+            t->state = INITIAL;
+            return token(t, p, 1, EOL);
+        case '"':
+            return quoted(t, p + 1);
+        case '#':			/* comment, through the newline */
+            if ((q = memchr(p, '\n', t->end - p)) == NULL)
+                break;
+            t->lineno++;
+            p = q;
+            continue;
+        case '\\':			/* continuation line */
+            for (q = p + 1; q < t->end && (*q == ' ' || *q == '\t' ||
+                    *q == '\r'); q++)
+                ;
+            if (q == t->end || *q != '\n')
+                break;
+            t->lineno++;
+            p = q;
+            continue;
+        }
+
+        c = *p;
+        if (t->state == HEX) {
+            /* {Hex}{Hex}?, else anything ends the hex */
+            if ((h = hexval(c)) >= 0) {
+                if (p + 1 < t->end && hexval(p[1]) >= 0) {
+                    t->yyval = h << 4 | hexval(p[1]);
+                    return token(t, p, 2, INT);
+                }
+                t->yyval = h;
+                return token(t, p, 1, INT);
+            }
+            t->state = INITIAL;
+            for (q = p; q < t->end && ISALPHA(*q); q++)
+                ;
+            if (q - p < 2)
+                q = p + 1;
+            return token(t, p, q - p, ERR);
+        }
+
+        if (ISDIGIT(c) || ((c == '-' || c == '+') && p + 1 < t->end &&
+                ISDIGIT(p[1])))
+            return number(t, p);
+        if (ISALPHA(c))
+            return word(t, p);
+        switch (c) {
+        case ':':
+        case '/':
+            return token(t, p, 1, '/');
+        case '$':
+            for (q = p + 1; q < t->end &&
+                    (ISDIGIT(*q) ? *q >= '1' && *q <= '8'
+                    : (*q | 0x20) >= 'a' && (*q | 0x20) <= 'h'); q++)
+                ;
+            if (q - p < 2)
+                break;
+            t->yyval = bankno((char *)p + 1, q - p - 1);
+            return token(t, p, q - p, INT);
+        }
+        return token(t, p, 1, ERR);
+    }
+    return token(t, t->end, 0, EOF);
+}
+
+/*
+ * Take in all of f for yylex() (or if f is NULL, the text the caller
+ * has put between t->cur and t->end), and skip a byte order mark.
+ * Returns -1 if the input starts with one that is not UTF-8.
+ */
+int
+yyload(struct t2mf *t, FILE *f) {
+    unsigned char *buf = t->inbuf;
+    size_t leng = 0, size = t->insize, n;
+#if _POSIX_C_SOURCE >= 2
+    struct stat st;
+    off_t off;
+#endif
+
+    if (f == NULL)
+        goto bom;
+#if _POSIX_C_SOURCE >= 2
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+            (off = ftello(f)) >= 0 && st.st_size > off) {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (buf != MAP_FAILED) {
+            t->map = buf;
+            t->mapsize = st.st_size;
+            t->cur = buf + off;
+            t->end = buf + st.st_size;
+            goto bom;
+        }
+        buf = t->inbuf;
+    }
+#endif
+    do {
+        if (leng == size) {
+            size = size ? 2 * size : 65536;
+            if ((buf = realloc(buf, size)) == NULL) {
+                error(t, "input buffer realloc failed");
+                exit(1);
+            }
+            t->inbuf = buf;
+            t->insize = size;
+        }
+        leng += n = fread(buf + leng, 1, size - leng, f);
+    } while (n > 0);
+    if (ferror(f)) {
+        perror("t2mf");
+        exit(1);
+    }
+    t->cur = buf;
+    t->end = buf + leng;
+
+bom:
+    if (t->cur < t->end && *t->cur == 0xef) {
+        if (t->end - t->cur < 3 || t->cur[1] != 0xbb || t->cur[2] != 0xbf)
+            return -1;
+        t->cur += 3;
+    }
+    return 0;
+}
+
+/* done with the input; a read-in buffer is kept for the next */
+void
+yyunload(struct t2mf *t) {
+#if _POSIX_C_SOURCE >= 2
+    if (t->map)
+        munmap(t->map, t->mapsize);
+#endif
+    t->map = NULL;
+    t->cur = t->end = NULL;
+}
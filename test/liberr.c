@@ -0,0 +1,138 @@
+/*
+ * liberr: the error returns of libmidifile, for make TESTED.
+ *
+ * Each MIDI file named is read with noexit set three ways (from a
+ * buffer, a byte at a time through Mf_getc, and pushed in pieces of
+ * 7 bytes), and what each returned is written out with err: the
+ * reason, the offset and the track.  They should agree.  Then a
+ * writer with noexit set writes a file whose Mf_putbuf fails on the
+ * second track, and whose third track has an event too big to write,
+ * once from inside Mf_wtrack and once between mf_w_track_begin_r() and
+ * mf_w_track_end_r(); the fourth track is begun again and written.
+ * Last, an event that fails with no track begun at all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "midifile.h"
+
+static FILE *In;
+
+static int
+mygetc(struct mf_reader *r) {
+    (void) r;
+    return(getc(In));
+}
+
+static void
+report(const char *how, int status, const struct mf_error *err) {
+    printf("%s: %d", how, status);
+    if (err->reason[0])
+        printf(" \"%s\" offset=%lu track=%d", err->reason,
+                (unsigned long)err->offset, err->track);
+    printf("\n");
+}
+
+static void
+readfile(const char *name) {
+    static mf_data_t buf[1 << 16];
+    struct mf_reader r;
+    mf_size_t len, i, n;
+    int status;
+
+    if ((In = fopen(name, "rb")) == NULL) {
+        perror(name);
+        exit(1);
+    }
+    len = fread(buf, 1, sizeof(buf), In);
+    printf("%s\n", name);
+
+    mf_reader_init(&r);
+    r.noexit = 1;
+    report("buf", mfread_buf_r(&r, buf, len), &r.err);
+    mf_reader_free(&r);
+
+    rewind(In);
+    mf_reader_init(&r);
+    r.noexit = 1;
+    r.Mf_getc = mygetc;
+    report("getc", mfread_r(&r), &r.err);
+    mf_reader_free(&r);
+    fclose(In);
+
+    mf_reader_init(&r);
+    r.noexit = 1;
+    status = 0;
+    for (i = 0; i < len && status == 0; i += n) {
+        n = len - i < 7 ? len - i : 7;
+        status = mfread_feed_r(&r, buf + i, n);
+    }
+    if (status == 0)
+        status = mfread_finish_r(&r);
+    report("feed", status, &r.err);
+    mf_reader_free(&r);
+}
+
+static int
+myputbuf(struct mf_writer *w, const mf_data_t *buf, mf_size_t size) {
+    static int calls;
+
+    (void) w;
+    (void) buf;
+    return(++calls == 3 ? -1 : (int)size);	/* the header, then tracks */
+}
+
+static void
+mywritetrack(struct mf_writer *w) {
+    mf_data_t data[2] = { 60, 64 };
+
+    mf_w_midi_event_r(w, 0, note_on, 0, data, 2);
+    if (w->data != NULL)		/* fail, and don’t come back */
+	printf("toobig: %d\n", mf_w_meta_event_r(w, 0, text_event, data,
+		(mf_size_t)-1));
+}
+
+static void
+writefile(void) {
+    mf_data_t data[2] = { 60, 64 };
+    struct mf_writer w;
+
+    mf_writer_init(&w);
+    w.noexit = 1;
+    w.Mf_putbuf = myputbuf;
+    w.Mf_wtrack = mywritetrack;
+    printf("write\n");
+    report("header", mf_w_header_r(&w, 1, 2, 96), &w.err);
+    report("track", mf_w_track_r(&w), &w.err);
+    report("track", mf_w_track_r(&w), &w.err);
+    w.data = &w;
+    report("track", mf_w_track_r(&w), &w.err);
+    w.data = NULL;
+
+    report("begin", mf_w_track_begin_r(&w), &w.err);
+    report("note", mf_w_midi_event_r(&w, 0, note_on, 0, data, 2), &w.err);
+    report("toobig", mf_w_meta_event_r(&w, 0, text_event, data,
+	    (mf_size_t)-1), &w.err);
+    report("begin", mf_w_track_begin_r(&w), &w.err);
+    report("note", mf_w_midi_event_r(&w, 0, note_on, 0, data, 2), &w.err);
+    report("end", mf_w_track_end_r(&w), &w.err);
+    printf("offset=%lu\n", (unsigned long)w.offset);
+    mf_writer_free(&w);
+
+    mf_writer_init(&w);
+    w.noexit = 1;
+    report("loose", mf_w_sysex_event_r(&w, 0, data, (mf_size_t)-1), &w.err);
+    report("tempo", mf_w_tempo_r(&w, 0, 500000), &w.err);
+    mf_writer_free(&w);
+}
+
+int
+main(int argc, char **argv) {
+    int i;
+
+    for (i = 1; i < argc; i++)
+        readfile(argv[i]);
+    writefile();
+    return 0;
+}
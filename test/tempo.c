@@ -0,0 +1,100 @@
+/*
+ * tempo: the tempo map and mf_ticks2sec()/mf_sec2ticks(), for make
+ * TESTED.  The values they should give, in test/tempo.txt, are worked
+ * out by hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "midifile.h"
+
+static struct mf_tempo_map M;
+
+static void
+us(mf_ticks_t tick) {
+    uint64_t rem;
+    uint64_t t = mf_tempo_map_us(&M, tick, &rem);
+
+    printf("us %lu: %llu rem %llu\n", (unsigned long)tick,
+            (unsigned long long)t, (unsigned long long)rem);
+}
+
+static void
+ticks(uint64_t t) {
+    printf("ticks %llu: %lu\n", (unsigned long long)t,
+            (unsigned long)mf_tempo_map_ticks(&M, t));
+}
+
+static void
+next(mf_ticks_t tick, int *seg) {
+    uint64_t rem;
+    uint64_t t = mf_tempo_map_next(&M, tick, seg, &rem);
+
+    printf("next %lu: %llu rem %llu seg %d\n", (unsigned long)tick,
+            (unsigned long long)t, (unsigned long long)rem, *seg);
+}
+
+static void
+init(int division) {
+    printf("division %#x\n", (unsigned)division);
+    if (mf_tempo_map_init(&M, division) != 0) {
+        printf("no good\n");
+        exit(1);
+    }
+}
+
+int
+main(void) {
+    int seg = 0;
+
+    /* 96 a quarter note: 500000 from 0, 1000000 from 96, 400000 from 192 */
+    init(96);
+    us(96);
+    us(1);
+    mf_tempo_map_add(&M, 192, 250000);
+    mf_tempo_map_add(&M, 96, 1000000);	/* before the last */
+    mf_tempo_map_add(&M, 192, 400000);	/* in place of 250000 */
+    printf("segs %d\n", M.nsegs);
+    us(96);
+    us(144);
+    us(192);
+    us(288);
+    ticks(0);
+    ticks(5208);
+    ticks(5209);
+    ticks(750000);
+    ticks(1899999);
+    ticks(1900000);
+    next(0, &seg);
+    next(100, &seg);
+    next(300, &seg);
+    mf_tempo_map_free(&M);
+
+    /* 25 frames of 40 ticks a second: 1000 µs a tick, Tempos or not */
+    init(0xe728);
+    mf_tempo_map_add(&M, 10, 100000);
+    us(1000);
+    ticks(1000000);
+    mf_tempo_map_free(&M);
+
+    /* 30 drop frame, 29.97 frames of 80 ticks: 1001/2400 ms a tick */
+    init(0xe350);
+    us(1);
+    us(2400);
+    ticks(1000999);
+    ticks(1001000);
+    mf_tempo_map_free(&M);
+
+    printf("division 0x8000: %d\n", mf_tempo_map_init(&M, 0x8000));
+
+    printf("ticks2sec 192 96: %.6f\n", mf_ticks2sec(192, 96, 500000));
+    printf("ticks2sec 2400 0xe350: %.6f\n", mf_ticks2sec(2400, 0xe350, 0));
+    printf("sec2ticks 1 96: %lu\n",
+            (unsigned long)mf_sec2ticks(1.0, 96, 500000));
+    printf("sec2ticks 0.5 0xe728: %lu\n",
+            (unsigned long)mf_sec2ticks(0.5, 0xe728, 0));
+    printf("sec2ticks 1.001 0xe350: %lu\n",
+            (unsigned long)mf_sec2ticks(1.001, 0xe350, 0));
+    return 0;
+}